@@ -3,6 +3,7 @@
 extern "C"
 {
 	int LUA_API luaopen_cairo(lua_State *State);
+	void LUA_API luacairo_resetcaches(lua_State *State);
 }
 
 LUALIB_API int luaopen_cairo(lua_State *State)
@@ -11,3 +12,8 @@ LUALIB_API int luaopen_cairo(lua_State *State)
 	return 1;
 }
 
+LUALIB_API void luacairo_resetcaches(lua_State *State)
+{
+	ResetScriptCaches(State);
+}
+
@@ -0,0 +1,76 @@
+#ifndef buffer_h
+#define buffer_h
+
+#include <algorithm>
+
+#include "library.h"
+
+// Double buffers
+// cairo.buffer(count | table | packed string) creates a mutable packed array of doubles.  Indices are 1-based, as
+// with tables.  Bulk functions that accept packed arrays take buffers as well and can write into them in place.
+static int CreateDoubleBuffer(lua_State *State)
+{
+	if (lua_type(State, 1) == LUA_TNUMBER)
+	{
+		lua_Integer Count = lua_tointeger(State, 1);
+		if (Count < 0) return luaL_error(State, "Buffer size must not be negative.");
+		DoubleBuffer *Buffer = PushDoubleBuffer(State, lua_upvalueindex(1), Count);
+		std::fill(Buffer->Data, Buffer->Data + Count, 0.0);
+		return 1;
+	}
+	PackedArray<double> Values(State, 1);
+	DoubleBuffer *Buffer = PushDoubleBuffer(State, lua_upvalueindex(1), Values.Count);
+	std::copy(Values.Data, Values.Data + Values.Count, Buffer->Data);
+	return 1;
+}
+
+inline size_t CheckDoubleBufferIndex(lua_State *State, DoubleBuffer *Buffer, int Position)
+{
+	lua_Integer Index = luaL_checkinteger(State, Position);
+	if ((Index < 1) || ((size_t)Index > Buffer->Count))
+		luaL_error(State, "Index %d is outside the buffer (size %d).", (int)Index, (int)Buffer->Count);
+	return Index - 1;
+}
+
+static int GetDoubleBufferValue(lua_State *State)
+{
+	DoubleBuffer *Buffer = LuaValue<DoubleBuffer *>::Read(State, 1);
+	lua_pushnumber(State, Buffer->Data[CheckDoubleBufferIndex(State, Buffer, 2)]);
+	return 1;
+}
+
+static int SetDoubleBufferValue(lua_State *State)
+{
+	DoubleBuffer *Buffer = LuaValue<DoubleBuffer *>::Read(State, 1);
+	size_t Index = CheckDoubleBufferIndex(State, Buffer, 2);
+	Buffer->Data[Index] = luaL_checknumber(State, 3);
+	return 0;
+}
+
+static int GetDoubleBufferSize(lua_State *State)
+{
+	DoubleBuffer *Buffer = LuaValue<DoubleBuffer *>::Read(State, 1);
+	lua_pushinteger(State, Buffer->Count);
+	return 1;
+}
+
+static int DoubleBufferToTable(lua_State *State)
+{
+	DoubleBuffer *Buffer = LuaValue<DoubleBuffer *>::Read(State, 1);
+	lua_createtable(State, Buffer->Count, 0);
+	for (size_t Index = 0; Index < Buffer->Count; ++Index)
+	{
+		lua_pushnumber(State, Buffer->Data[Index]);
+		lua_rawseti(State, -2, Index + 1);
+	}
+	return 1;
+}
+
+static int DoubleBufferToString(lua_State *State)
+{
+	DoubleBuffer *Buffer = LuaValue<DoubleBuffer *>::Read(State, 1);
+	lua_pushlstring(State, reinterpret_cast<char const *>(Buffer->Data), Buffer->Count * sizeof(double));
+	return 1;
+}
+
+#endif
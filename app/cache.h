@@ -0,0 +1,131 @@
+#ifndef cache_h
+#define cache_h
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <new>
+
+#include "library.h"
+
+// Least recently used cache with a byte budget
+// Each entry is charged the size given when it is inserted; inserting evicts the least recently used entries until
+// the total fits the budget again (the new entry itself is always kept).  Values are handles released by Destroy when
+// they leave the cache.
+template <typename KeyType, typename ValueType> class LRUCache
+{
+	public:
+		typedef void (*DestroyFunction)(ValueType &Value);
+
+		LRUCache(size_t Budget, DestroyFunction Destroy) : Budget(Budget), Size(0), Destroy(Destroy) {}
+		~LRUCache(void) { Clear(); }
+
+		LRUCache(LRUCache const &) = delete;
+		LRUCache &operator =(LRUCache const &) = delete;
+
+		// Returns the value for Key and marks it most recently used, or nullptr
+		ValueType *Find(KeyType const &Key)
+		{
+			auto Found = Index.find(Key);
+			if (Found == Index.end()) return nullptr;
+			Entries.splice(Entries.begin(), Entries, Found->second);
+			return &Found->second->Value;
+		}
+
+		ValueType &Insert(KeyType const &Key, ValueType const &Value, size_t ValueSize)
+		{
+			Erase(Key);
+			Entries.push_front(Entry{Key, Value, ValueSize});
+			Index[Key] = Entries.begin();
+			Size += ValueSize;
+			Trim();
+			return Entries.front().Value;
+		}
+
+		void Erase(KeyType const &Key)
+		{
+			auto Found = Index.find(Key);
+			if (Found == Index.end()) return;
+			Remove(Found->second);
+			Index.erase(Found);
+		}
+
+		void Clear(void)
+		{
+			for (auto &Current : Entries) Destroy(Current.Value);
+			Entries.clear();
+			Index.clear();
+			Size = 0;
+		}
+
+		void SetBudget(size_t NewBudget)
+		{
+			Budget = NewBudget;
+			Trim();
+		}
+
+		size_t GetBudget(void) const { return Budget; }
+		size_t GetSize(void) const { return Size; }
+		size_t GetCount(void) const { return Entries.size(); }
+
+	private:
+		struct Entry
+		{
+			KeyType Key;
+			ValueType Value;
+			size_t Size;
+		};
+
+		void Remove(typename std::list<Entry>::iterator Position)
+		{
+			Size -= Position->Size;
+			Destroy(Position->Value);
+			Entries.erase(Position);
+		}
+
+		void Trim(void)
+		{
+			while ((Size > Budget) && (Entries.size() > 1))
+			{
+				auto Last = std::prev(Entries.end());
+				Index.erase(Last->Key);
+				Remove(Last);
+			}
+		}
+
+		size_t Budget;
+		size_t Size;
+		DestroyFunction Destroy;
+		std::list<Entry> Entries;
+		std::unordered_map<KeyType, typename std::list<Entry>::iterator> Index;
+};
+
+// Per state objects
+// Returns the instance of Type kept in the registry under Key, creating it from Arguments on first use.  It is
+// destroyed when the state is closed.
+template <typename Type> int DestroyStateObject(lua_State *State)
+{
+	static_cast<Type *>(lua_touserdata(State, 1))->~Type();
+	return 0;
+}
+
+template <typename Type, typename... ArgumentTypes> Type *GetStateObject(lua_State *State, UID Key, ArgumentTypes const &... Arguments)
+{
+	lua_pushlightuserdata(State, Key);
+	lua_rawget(State, LUA_REGISTRYINDEX);
+	Type *Object = static_cast<Type *>(lua_touserdata(State, -1));
+	lua_pop(State, 1);
+	if (Object != nullptr) return Object;
+
+	lua_pushlightuserdata(State, Key);
+	Object = new (lua_newuserdata(State, sizeof(Type))) Type(Arguments...);
+	lua_newtable(State);
+	lua_pushstring(State, "__gc");
+	lua_pushcfunction(State, DestroyStateObject<Type>);
+	lua_settable(State, -3);
+	lua_setmetatable(State, -2);
+	lua_rawset(State, LUA_REGISTRYINDEX);
+	return Object;
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef imagedata_h
+#define imagedata_h
+
+#include "library.h"
+
+// Image surface pixel access
+// Exposes an image surface's memory in place.  Holds a reference to the surface so the memory stays valid as long
+// as the data object does.  Rows are numbered from 0 and are read and written whole, including stride padding.
+struct ImageData
+{
+	cairo_surface_t *Surface;
+	unsigned char *Data;
+	cairo_format_t Format;
+	int Width;
+	int Height;
+	int Stride;
+};
+
+ImageData *GetImageData(cairo_surface_t *Surface)
+{
+	cairo_surface_flush(Surface);
+	ImageData *Out = new ImageData;
+	Out->Surface = cairo_surface_reference(Surface);
+	Out->Data = cairo_image_surface_get_data(Surface);
+	Out->Format = cairo_image_surface_get_format(Surface);
+	Out->Width = cairo_image_surface_get_width(Surface);
+	Out->Height = cairo_image_surface_get_height(Surface);
+	Out->Stride = cairo_image_surface_get_stride(Surface);
+	return Out;
+}
+
+void DestroyImageData(ImageData *Data)
+{
+	cairo_surface_destroy(Data->Surface);
+	delete Data;
+}
+
+cairo_format_t GetImageDataFormat(ImageData *Data) { return Data->Format; }
+int GetImageDataWidth(ImageData *Data) { return Data->Width; }
+int GetImageDataHeight(ImageData *Data) { return Data->Height; }
+int GetImageDataStride(ImageData *Data) { return Data->Stride; }
+void MarkImageDataDirty(ImageData *Data) { cairo_surface_mark_dirty(Data->Surface); }
+
+inline int CheckImageDataRows(lua_State *State, ImageData *Data, int Position, lua_Integer Count)
+{
+	lua_Integer First = luaL_checkinteger(State, Position);
+	if ((Data->Data == nullptr) || (First < 0) || (Count < 0) || (First + Count > Data->Height))
+		luaL_error(State, "Rows %d to %d are outside the image data (%d rows).", (int)First, (int)(First + Count), Data->Height);
+	return (int)First;
+}
+
+static int GetImageDataRows(lua_State *State)
+{
+	ImageData *Data = LuaValue<ImageData *>::Read(State, 1);
+	lua_Integer Count = luaL_optinteger(State, 3, 1);
+	int First = CheckImageDataRows(State, Data, 2, Count);
+	cairo_surface_flush(Data->Surface);
+	lua_pushlstring(State, reinterpret_cast<char const *>(Data->Data + (size_t)First * Data->Stride), (size_t)Count * Data->Stride);
+	return 1;
+}
+
+static int SetImageDataRows(lua_State *State)
+{
+	ImageData *Data = LuaValue<ImageData *>::Read(State, 1);
+	size_t Length;
+	char const *Rows = luaL_checklstring(State, 3, &Length);
+	if ((Data->Data == nullptr) || (Data->Stride == 0)) return luaL_error(State, "Surface has no image data.");
+	if (Length % Data->Stride != 0)
+		return luaL_error(State, "Row data length %d isn't a multiple of the stride (%d).", (int)Length, Data->Stride);
+	lua_Integer Count = Length / Data->Stride;
+	int First = CheckImageDataRows(State, Data, 2, Count);
+	cairo_surface_flush(Data->Surface);
+	memcpy(Data->Data + (size_t)First * Data->Stride, Rows, Length);
+	cairo_surface_mark_dirty_rectangle(Data->Surface, 0, First, Data->Width, (int)Count);
+	return 0;
+}
+
+static int GetImageDataString(lua_State *State)
+{
+	ImageData *Data = LuaValue<ImageData *>::Read(State, 1);
+	if (Data->Data == nullptr) return luaL_error(State, "Surface has no image data.");
+	cairo_surface_flush(Data->Surface);
+	lua_pushlstring(State, reinterpret_cast<char const *>(Data->Data), (size_t)Data->Height * Data->Stride);
+	return 1;
+}
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef instances_h
+#define instances_h
+
+#include <cmath>
+
+#include "library.h"
+
+// Instanced drawing
+// context:instances(path, positions[, colors]) fills path once for each x, y pair in positions (in user space, as if
+// translated there), with the current source or with the r, g, b, a quadruple in colors for each instance.  The path is
+// rasterized once with the current transformation, fill rule, antialiasing and tolerance into a mask that is then
+// stamped at each position, so instances are snapped to whole device pixels.  The current path is left alone.
+static int DrawInstances(lua_State *State)
+{
+	cairo_t *Context = LuaValue<cairo_t *>::Read(State, 1);
+	cairo_path_t *Path = LuaValue<cairo_path_t *>::Read(State, 2);
+	lua_settop(State, 4);
+	if (lua_isnil(State, 4))
+	{
+		lua_pushliteral(State, "");
+		lua_replace(State, 4);
+	}
+	PackedArray<double> Positions(State, 3);
+	PackedArray<double> Colors(State, 4);
+	if (Positions.Count % 2 != 0)
+		return luaL_error(State, "Parameter 3 must contain x, y pairs, but it has %d values.", (int)Positions.Count);
+	size_t const Count = Positions.Count / 2;
+	if ((Colors.Count != 0) && (Colors.Count != Count * 4))
+		return luaL_error(State, "Parameter 4 must contain an r, g, b, a quadruple for each of the %d positions.", (int)Count);
+	if (Count == 0) return 0;
+
+	// Find the device space bounds of the path without the translation, since every instance has its own
+	cairo_matrix_t Matrix;
+	cairo_get_matrix(Context, &Matrix);
+	cairo_matrix_t Linear = Matrix;
+	Linear.x0 = Linear.y0 = 0;
+	cairo_surface_t *Mask = cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
+	cairo_t *Stamp = cairo_create(Mask);
+	cairo_set_matrix(Stamp, &Linear);
+	cairo_append_path(Stamp, Path);
+	cairo_identity_matrix(Stamp);
+	double Left, Top, Right, Bottom;
+	cairo_fill_extents(Stamp, &Left, &Top, &Right, &Bottom);
+	cairo_destroy(Stamp);
+	cairo_surface_destroy(Mask);
+	if ((Right <= Left) || (Bottom <= Top)) return 0;
+	Left = floor(Left);
+	Top = floor(Top);
+
+	Mask = cairo_image_surface_create(CAIRO_FORMAT_A8, (int)(ceil(Right) - Left), (int)(ceil(Bottom) - Top));
+	if (cairo_surface_status(Mask) != CAIRO_STATUS_SUCCESS)
+	{
+		cairo_status_t Status = cairo_surface_status(Mask);
+		cairo_surface_destroy(Mask);
+		return luaL_error(State, "Creating the instance mask failed: %s", cairo_status_to_string(Status));
+	}
+	Stamp = cairo_create(Mask);
+	Linear.x0 = -Left;
+	Linear.y0 = -Top;
+	cairo_set_matrix(Stamp, &Linear);
+	cairo_set_fill_rule(Stamp, cairo_get_fill_rule(Context));
+	cairo_set_antialias(Stamp, cairo_get_antialias(Context));
+	cairo_set_tolerance(Stamp, cairo_get_tolerance(Context));
+	cairo_append_path(Stamp, Path);
+	cairo_fill(Stamp);
+	cairo_destroy(Stamp);
+
+	// One pattern moved around rather than a new one per instance
+	cairo_pattern_t *Pattern = cairo_pattern_create_for_surface(Mask);
+	cairo_surface_destroy(Mask);
+	cairo_save(Context);
+	cairo_identity_matrix(Context);
+	for (size_t Index = 0; Index < Count; ++Index)
+	{
+		double X = Positions.Data[Index * 2], Y = Positions.Data[Index * 2 + 1];
+		cairo_matrix_transform_point(&Matrix, &X, &Y);
+		cairo_matrix_t Offset;
+		cairo_matrix_init_translate(&Offset, -(floor(X + 0.5) + Left), -(floor(Y + 0.5) + Top));
+		cairo_pattern_set_matrix(Pattern, &Offset);
+		if (Colors.Count != 0)
+		{
+			double const *Color = Colors.Data + Index * 4;
+			cairo_set_source_rgba(Context, Color[0], Color[1], Color[2], Color[3]);
+		}
+		cairo_mask(Context, Pattern);
+	}
+	cairo_restore(Context);
+	cairo_pattern_destroy(Pattern);
+	return 0;
+}
+
+#endif
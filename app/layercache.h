@@ -0,0 +1,136 @@
+#ifndef layercache_h
+#define layercache_h
+
+#include <cmath>
+#include <algorithm>
+
+#include "cache.h"
+#include "tiled.h"
+
+// Layer cache
+// context:layercache(key, width, height, draw[, rasterize]) paints a layer covering (0, 0, width, height) in user
+// space.  The first time, draw is called with a context for a new recording surface and the result is kept under key;
+// later calls with the same width and height only replay it.  If rasterize is set the layer is instead drawn into an
+// image surface at the current device resolution (times rasterize, if it is a number) and blitted, and it is redrawn
+// when the scale of the current transformation changes.  Layers are evicted least recently used first once their
+// total size passes the budget (cairo.setlayercachebudget, in bytes).  Recording layers are charged a nominal size
+// since their real size isn't known.
+struct CachedLayer
+{
+	cairo_surface_t *Surface;
+	double Width, Height;
+	double Resolution; // 0 for recording layers
+	double ScaleX, ScaleY;
+};
+
+inline void DestroyCachedLayer(CachedLayer &Layer) { cairo_surface_destroy(Layer.Surface); }
+
+typedef LRUCache<std::string, CachedLayer> LayerCache;
+
+static UIDObject LayerCacheKey;
+size_t const DefaultLayerCacheBudget = 64 << 20;
+size_t const RecordingLayerSize = 16 << 10;
+
+inline LayerCache *GetLayerCache(lua_State *State)
+	{ return GetStateObject<LayerCache>(State, LayerCacheKey, DefaultLayerCacheBudget, &DestroyCachedLayer); }
+
+inline bool IsSameScale(double First, double Second)
+	{ return fabs(First - Second) <= 1e-6 * std::max(fabs(First), fabs(Second)); }
+
+static int DrawCachedLayer(lua_State *State)
+{
+	cairo_t *Context = LuaValue<cairo_t *>::Read(State, 1);
+	size_t KeyLength;
+	char const *Key = luaL_checklstring(State, 2, &KeyLength);
+	double const Width = LuaValue<double>::Read(State, 3);
+	double const Height = LuaValue<double>::Read(State, 4);
+	luaL_checktype(State, 5, LUA_TFUNCTION);
+	double const Resolution = lua_type(State, 6) == LUA_TNUMBER ? lua_tonumber(State, 6) : (lua_toboolean(State, 6) ? 1.0 : 0.0);
+	if ((Width <= 0) || (Height <= 0)) return luaL_error(State, "Layer width and height must be positive.");
+	if (Resolution < 0) return luaL_error(State, "Parameter 6 must not be negative.");
+
+	// Device pixels per user unit along each axis
+	double XX = 1, XY = 0, YX = 0, YY = 1;
+	cairo_user_to_device_distance(Context, &XX, &XY);
+	cairo_user_to_device_distance(Context, &YX, &YY);
+	double const ScaleX = hypot(XX, XY) * Resolution;
+	double const ScaleY = hypot(YX, YY) * Resolution;
+	if ((Resolution > 0) && ((ScaleX == 0) || (ScaleY == 0))) return 0;
+
+	LayerCache *Cache = GetLayerCache(State);
+	std::string const CacheKey(Key, KeyLength);
+	CachedLayer *Layer = Cache->Find(CacheKey);
+	if ((Layer != nullptr) && ((Layer->Width != Width) || (Layer->Height != Height) || (Layer->Resolution != Resolution) ||
+		((Resolution > 0) && (!IsSameScale(Layer->ScaleX, ScaleX) || !IsSameScale(Layer->ScaleY, ScaleY)))))
+		Layer = nullptr;
+
+	if (Layer == nullptr)
+	{
+		CachedLayer Created = {nullptr, Width, Height, Resolution, ScaleX, ScaleY};
+		size_t Size = RecordingLayerSize;
+		if (Resolution > 0)
+		{
+			int const PixelWidth = std::max(1, (int)ceil(Width * ScaleX));
+			int const PixelHeight = std::max(1, (int)ceil(Height * ScaleY));
+			Created.Surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, PixelWidth, PixelHeight);
+			Size = (size_t)cairo_image_surface_get_stride(Created.Surface) * PixelHeight;
+		}
+		else
+		{
+#ifdef CAIRO_HAS_RECORDING_SURFACE
+			cairo_rectangle_t const Extents = {0, 0, Width, Height};
+			Created.Surface = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, &Extents);
+#else
+			return luaL_error(State, "Recording surfaces aren't available, layers must be rasterized.");
+#endif
+		}
+		cairo_t *LayerContext = cairo_create(Created.Surface);
+		if (Resolution > 0) cairo_scale(LayerContext, ScaleX, ScaleY);
+
+		// The layer context belongs to Lua from here on
+		lua_pushvalue(State, 5);
+		PushMetatable(State, AsUID(cairo_create));
+		LuaValue<cairo_t *>::Write(State, lua_gettop(State), LayerContext);
+		lua_remove(State, -2);
+		if (lua_pcall(State, 1, 0, 0) != LUA_OK)
+		{
+			cairo_surface_destroy(Created.Surface);
+			return lua_error(State);
+		}
+		cairo_surface_flush(Created.Surface);
+		Layer = &Cache->Insert(CacheKey, Created, Size);
+	}
+
+	cairo_save(Context);
+	if (Layer->Resolution > 0) cairo_scale(Context, 1 / Layer->ScaleX, 1 / Layer->ScaleY);
+	SetSourceSurface(Context, Layer->Surface, 0, 0);
+	cairo_paint(Context);
+	cairo_restore(Context);
+	return 0;
+}
+
+static int SetLayerCacheBudget(lua_State *State)
+{
+	lua_Number Budget = LuaValue<double>::Read(State, 1);
+	if (Budget < 0) return luaL_error(State, "Layer cache budget must not be negative.");
+	GetLayerCache(State)->SetBudget((size_t)Budget);
+	return 0;
+}
+
+static int GetLayerCacheSize(lua_State *State)
+{
+	// Returns bytes used, layer count and budget
+	LayerCache *Cache = GetLayerCache(State);
+	lua_pushnumber(State, Cache->GetSize());
+	lua_pushinteger(State, Cache->GetCount());
+	lua_pushnumber(State, Cache->GetBudget());
+	return 3;
+}
+
+static int ClearLayerCache(lua_State *State)
+{
+	GetLayerCache(State)->Clear();
+	return 0;
+}
+
+#endif
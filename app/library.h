@@ -2,11 +2,15 @@
 #define library_h
 
 #include <cstring>
+#include <cstdlib>
+#include <cstdint>
 #include <string>
 #include <typeinfo>
 #include <cassert>
 #include <iostream>
 #include <utility>
+#include <new>
+#include <type_traits>
 
 #include <cairo/cairo.h>
 #include <cairo/cairo-svg.h>
@@ -31,9 +35,13 @@ template <typename KeyType, KeyType *Key> struct UIDWrapper { static uint8_t Val
 template <typename KeyType, KeyType *Key> uint8_t UIDWrapper<KeyType, Key>::Value = 7;
 #define AsUID(Function) &UIDWrapper<decltype(Function), Function>::Value
 
-template <typename Base> struct PointerWithoutConst { typedef Base *Type; };
+template <typename Base> struct PointerWithoutConst { typedef Base Type; };
 template <typename Base> struct PointerWithoutConst<Base const *> { typedef Base *Type; };
 
+template <size_t... Indices> struct IndexSequence {};
+template <size_t Count, size_t... Indices> struct MakeIndexSequence : MakeIndexSequence<Count - 1, Count - 1, Indices...> {};
+template <size_t... Indices> struct MakeIndexSequence<0, Indices...> { typedef IndexSequence<Indices...> Type; };
+
 template <typename... Catchall> struct ReverseTuple {};
 
 template <typename Next, typename... Remaining, typename... Done> struct ReverseTuple<std::tuple<Next, Remaining...>, std::tuple<Done...> >
@@ -46,12 +54,6 @@ template <typename... Done> struct ReverseTuple<std::tuple<>, std::tuple<Done...
 	typedef std::tuple<Done...> Tuple;
 };
 
-template <typename Type> size_t TypeIDLength(void)
-{
-	static const size_t Length = strlen(typeid(Type).name());
-	return Length;
-}
-
 //-- Combine a object accessor and object referencer at compile time
 // If you have get_a and reference_a, creates a function that does: a = get_a; reference_a(a); return a;
 namespace ReferenceInternal
@@ -95,19 +97,41 @@ namespace ReferenceInternal
 #define Reference(Accessor, Referencer) \
 	ReferenceInternal::Reference<decltype(&Accessor), Accessor, decltype(&Referencer), Referencer>::Callback
 
+//-- Argument errors
+// Kept out of line and marked cold so the checks in every reader stay a compare and a branch.
+#ifdef __GNUC__
+#define ColdFunction __attribute__((noinline, cold))
+#else
+#define ColdFunction
+#endif
+
+[[noreturn]] ColdFunction inline void ArgumentError(lua_State *State, int Position, char const *TypeName)
+{
+	luaL_error(State, "Parameter %d must be of type \"%s\", but it is a \"%s\".", lua_absindex(State, Position), TypeName, lua_typename(State, lua_type(State, Position)));
+	abort(); // Unreachable
+}
+
+[[noreturn]] ColdFunction inline void ReleasedObjectError(lua_State *State, int Position)
+{
+	luaL_error(State, "Parameter %d has been released.", lua_absindex(State, Position));
+	abort(); // Unreachable
+}
+
 //-- Templatized Lua stack IO
+// Write takes the index of the metatable to give new objects (a pseudo or absolute index); it's ignored for plain values.
 template <typename Type> struct LuaValue
 {
 	// Should handle ints and enums.  Unrecognized types will also get mapped this way.
 	static Type Read(lua_State *State, int Position)
 	{
 		// No specialized read function implemented for this type.
-		if (!lua_isnumber(State, Position)) 
-			luaL_error(State, "Parameter %d must be of type \"%s\", but it is a \"%s\".", Position < 0 ? lua_gettop(State) + 1 + Position : Position, typeid(Type).name(), lua_typename(State, lua_type(State, Position)));
-		return (Type)lua_tonumber(State, Position);
+		int IsNumber;
+		lua_Number Value = lua_tonumberx(State, Position, &IsNumber);
+		if (!IsNumber) ArgumentError(State, Position, typeid(Type).name());
+		return (Type)Value;
 	}
 
-	static void Write(lua_State *State, UID, Type const &Value)
+	static void Write(lua_State *State, int, Type const &Value)
 	{
 		// No specialized write function implemented for this type.
 	       	lua_pushinteger(State, Value); 
@@ -118,25 +142,37 @@ template <> struct LuaValue<double>
 {
 	static double Read(lua_State *State, int Position)
 	{
-		if (!lua_isnumber(State, Position)) 
-			luaL_error(State, "Parameter %d must be a double, but it is a \"%s\".", Position < 0 ? lua_gettop(State) + 1 + Position : Position, lua_typename(State, lua_type(State, Position)));
-		return lua_tonumber(State, Position);
+		int IsNumber;
+		lua_Number Value = lua_tonumberx(State, Position, &IsNumber);
+		if (!IsNumber) ArgumentError(State, Position, "double");
+		return Value;
 	}
 
-	static void Write(lua_State *State, UID, double const &Value)
+	static void Write(lua_State *State, int, double const &Value)
 		{ lua_pushnumber(State, Value); }
 };
 
+// Reads Count consecutive doubles starting at Position
+inline void ReadDoubles(lua_State *State, int Position, double *Values, size_t Count)
+{
+	for (size_t Index = 0; Index < Count; ++Index)
+	{
+		int IsNumber;
+		Values[Index] = lua_tonumberx(State, Position + (int)Index, &IsNumber);
+		if (!IsNumber) ArgumentError(State, Position + (int)Index, "double");
+	}
+}
+
 template <> struct LuaValue<char *>
 {
 	static char const *Read(lua_State *State, int Position)
 	{
-		if (!lua_isstring(State, Position)) 
-			luaL_error(State, "Parameter %d must be a string, but it was not.", Position);
-		return lua_tostring(State, Position);
+		char const *Value = lua_tostring(State, Position);
+		if (Value == nullptr) ArgumentError(State, Position, "string");
+		return Value;
 	}
 
-	static void Write(lua_State *State, UID, char * const &Value)
+	static void Write(lua_State *State, int, char * const &Value)
 		{ lua_pushstring(State, Value); }
 };
 
@@ -144,129 +180,507 @@ template <> struct LuaValue<char const *>
 {
 	static char const *Read(lua_State *State, int Position)
 	{
-		if (!lua_isstring(State, Position)) 
-			luaL_error(State, "Parameter %d must be a string, but it was not.", Position);
-		return lua_tostring(State, Position);
+		char const *Value = lua_tostring(State, Position);
+		if (Value == nullptr) ArgumentError(State, Position, "string");
+		return Value;
 	}
 
-	static void Write(lua_State *State, UID, char const * const &Value)
+	static void Write(lua_State *State, int, char const * const &Value)
 		{ lua_pushstring(State, Value); }
 };
 
-inline void SetMetatable(lua_State *State, UID TypeUID);
+//-- Type tags
+// Every bound type has one static tag and the tag's address identifies the type; const and non-const share the tag.
+// Tags are only ever compared, never followed, since the header of a foreign userdata can hold anything.
+struct TypeTag {};
+
+template <typename Type> struct TypeTagOf { static TypeTag const Value; };
+template <typename Type> TypeTag const TypeTagOf<Type>::Value = {};
+template <typename Type> struct TypeTagOf<Type const> : TypeTagOf<Type> {};
+#define TagOf(Type) (&TypeTagOf<Type>::Value)
+
+//-- Bound objects
+// Objects are full userdata beginning with this header.  The type is checked by comparing tag addresses.
+struct ObjectHeader
+{
+	TypeTag const *Type;
+	void *Data;
+};
+
+inline bool IsObjectOfType(lua_State *State, int Position, TypeTag const *Wanted)
+{
+	ObjectHeader *Header = static_cast<ObjectHeader *>(lua_touserdata(State, Position));
+	return (lua_type(State, Position) == LUA_TUSERDATA) &&
+		(lua_rawlen(State, Position) >= sizeof(ObjectHeader)) &&
+		(Header->Type == Wanted);
+}
+
 template <typename Type> struct LuaValue<Type *>
 {
 	static Type *Read(lua_State *State, int Position)
 	{
-		try
-		{
-			if (!lua_istable(State, Position)) 
-				throw std::string(lua_typename(State, lua_type(State, Position)));
+		if (!IsObjectOfType(State, Position, TagOf(Type)))
+			ArgumentError(State, Position, typeid(Type *).name());
+		void *Data = static_cast<ObjectHeader *>(lua_touserdata(State, Position))->Data;
+		if (Data == nullptr) ReleasedObjectError(State, Position);
+		return reinterpret_cast<Type *>(Data);
+	}
 
+	static void Write(lua_State *State, int Metatable, Type *const &Value)
+	{
 #ifndef NDEBUG
-			unsigned int InitialHeight = lua_gettop(State);
+		assert(Metatable != 0);
+		unsigned int InitialHeight = lua_gettop(State);
 #endif
+		ObjectHeader *Header = static_cast<ObjectHeader *>(lua_newuserdata(State, sizeof(ObjectHeader)));
+		Header->Type = TagOf(Type);
+		Header->Data = const_cast<typename PointerWithoutConst<Type *>::Type>(Value);
 
-			lua_pushstring(State, "_type");
-			lua_gettable(State, Position);
-			if (lua_isnil(State, -1)) throw std::string("table");
-			size_t TypeLength;
-			lua_tolstring(State, -1, &TypeLength);
-			if (TypeLength == TypeIDLength<Type *>())
-			{
-				if (strncmp(typeid(Type *).name(), lua_tostring(State, -1), TypeLength) != 0)
-					throw std::string(lua_tostring(State, -1));
-			}
-			else if (TypeLength == TypeIDLength<typename PointerWithoutConst<Type *>::Type>())
-			{
-				if (strncmp(typeid(typename PointerWithoutConst<Type *>::Type).name(), lua_tostring(State, -1), TypeLength) != 0)
-					throw std::string(lua_tostring(State, -1));
-			}
-			else throw std::string(lua_tostring(State, -1));
-			lua_pop(State, 1);
+		lua_pushvalue(State, Metatable);
+		assert(lua_istable(State, -1));
+		lua_setmetatable(State, -2);
+#ifndef NDEBUG
+		assert((unsigned int)lua_gettop(State) == InitialHeight + 1);
+		assert(lua_isuserdata(State, -1));
+#endif
+	}
+};
 
-			lua_pushstring(State, "_data");
-			lua_gettable(State, Position);
-			if (!lua_isuserdata(State, -1)) throw std::string("table");
-			Type *Out = reinterpret_cast<Type *>(lua_touserdata(State, -1));
-			lua_pop(State, 1);
+// Value types stored inline after the object header, so the Lua GC owns them and no finalizer is needed.  Only for
+// types that are trivially destructible.  Read as pointers like any other object.
+template <typename Type> struct InlineValue
+{
+	static Type Read(lua_State *State, int Position)
+		{ return *LuaValue<Type *>::Read(State, Position); }
+
+	static void Write(lua_State *State, int Metatable, Type const &Value)
+	{
+#ifndef NDEBUG
+		assert(Metatable != 0);
+		unsigned int InitialHeight = lua_gettop(State);
+#endif
+		ObjectHeader *Header = static_cast<ObjectHeader *>(lua_newuserdata(State, sizeof(ObjectHeader) + sizeof(Type)));
+		Header->Type = TagOf(Type);
+		Header->Data = new (Header + 1) Type(Value);
 
+		lua_pushvalue(State, Metatable);
+		assert(lua_istable(State, -1));
+		lua_setmetatable(State, -2);
 #ifndef NDEBUG
-			assert((unsigned int)lua_gettop(State) == InitialHeight);
+		assert((unsigned int)lua_gettop(State) == InitialHeight + 1);
 #endif
+	}
+};
+
+//-- Packed arrays
+// Mutable array of doubles stored inline in its object, after the header.
+struct DoubleBuffer
+{
+	size_t Count;
+	double *Data;
+};
+
+inline DoubleBuffer *PushDoubleBuffer(lua_State *State, int Metatable, size_t Count)
+{
+	Metatable = lua_absindex(State, Metatable);
+	if (Count > (SIZE_MAX - sizeof(ObjectHeader) - sizeof(DoubleBuffer)) / sizeof(double))
+		luaL_error(State, "Buffer size %f is too large.", (double)Count);
+	ObjectHeader *Header = static_cast<ObjectHeader *>(lua_newuserdata(State, sizeof(ObjectHeader) + sizeof(DoubleBuffer) + Count * sizeof(double)));
+	DoubleBuffer *Buffer = reinterpret_cast<DoubleBuffer *>(Header + 1);
+	Buffer->Count = Count;
+	Buffer->Data = reinterpret_cast<double *>(Buffer + 1);
+	Header->Type = TagOf(DoubleBuffer);
+	Header->Data = Buffer;
+	lua_pushvalue(State, Metatable);
+	assert(lua_istable(State, -1));
+	lua_setmetatable(State, -2);
+	return Buffer;
+}
 
-			return Out;
+// How an element is spelled in a Lua sequence: as Fields consecutive numbers.  Specialized for structures.
+template <typename Element> struct PackedElement
+{
+	static constexpr int Fields = 1;
+	static void Set(Element &Out, double const *Values) { Out = (Element)Values[0]; }
+};
+
+// Reads an array of numbers passed either as a Lua sequence or as a string of packed native values (or a double
+// buffer, for doubles).  Strings and buffers are used in place; sequences are copied into a scratch userdata.  Either
+// way one value is pushed that keeps Data alive until it is popped.
+template <typename Element> struct PackedArray
+{
+	Element const *Data;
+	size_t Count;
+
+	PackedArray(lua_State *State, int Position) : Data(nullptr), Count(0)
+	{
+		Position = lua_absindex(State, Position);
+		if (std::is_same<Element, double>::value && IsObjectOfType(State, Position, TagOf(DoubleBuffer)))
+		{
+			DoubleBuffer *Buffer = static_cast<DoubleBuffer *>(static_cast<ObjectHeader *>(lua_touserdata(State, Position))->Data);
+			Data = reinterpret_cast<Element const *>(Buffer->Data);
+			Count = Buffer->Count;
+			lua_pushvalue(State, Position);
 		}
-		catch (std::string &Typename)
+		else if (lua_type(State, Position) == LUA_TSTRING)
 		{
-			luaL_error(State, "Parameter %d must be of type \"%s\", but it was a \"%s\".", Position, typeid(Type *).name(), Typename.c_str());
-			return nullptr; // Unreachable
+			size_t Length;
+			Data = reinterpret_cast<Element const *>(lua_tolstring(State, Position, &Length));
+			if (Length % sizeof(Element) != 0)
+				luaL_error(State, "Parameter %d is a packed array but its length isn't a multiple of %d.", Position, (int)sizeof(Element));
+			Count = Length / sizeof(Element);
+			lua_pushvalue(State, Position);
 		}
+		else if (lua_istable(State, Position))
+		{
+			int const Fields = PackedElement<Element>::Fields;
+			size_t const Length = lua_rawlen(State, Position);
+			if (Length % Fields != 0)
+				luaL_error(State, "Parameter %d must have a multiple of %d values, but it has %d.", Position, Fields, (int)Length);
+			Count = Length / Fields;
+			Element *Storage = static_cast<Element *>(lua_newuserdata(State, Count * sizeof(Element)));
+			double Values[Fields];
+			for (size_t Index = 0; Index < Count; ++Index)
+			{
+				for (int Field = 0; Field < Fields; ++Field)
+				{
+					lua_rawgeti(State, Position, Index * Fields + Field + 1);
+					int IsNumber;
+					Values[Field] = lua_tonumberx(State, -1, &IsNumber);
+					if (!IsNumber)
+						luaL_error(State, "Element %d of parameter %d must be a number, but it is a \"%s\".", (int)(Index * Fields) + Field + 1, Position, lua_typename(State, lua_type(State, -1)));
+					lua_pop(State, 1);
+				}
+				PackedElement<Element>::Set(Storage[Index], Values);
+			}
+			Data = Storage;
+		}
+		else luaL_error(State, "Parameter %d must be a table, buffer or packed string, but it is a \"%s\".", Position, lua_typename(State, lua_type(State, Position)));
 	}
+};
 
-	static void Write(lua_State *State, UID TypeUID, Type *const &Value)
-	{
+// Types that are pushed as objects and so need a metatable
+template <typename Type> struct IsObject { static constexpr bool Value = false; };
+template <typename Type> struct IsObject<Type *> { static constexpr bool Value = true; };
+template <> struct IsObject<char *> { static constexpr bool Value = false; };
+template <> struct IsObject<char const *> { static constexpr bool Value = false; };
+
+//-- Metatable tools
+inline void PushMetatable(lua_State *State, UID TypeUID)
+{
+	// Metatables are created on first reference, so functions can be bound to a metatable before it is populated.
 #ifndef NDEBUG
-		assert(TypeUID != nullptr);
-		unsigned int InitialHeight = lua_gettop(State);
+	unsigned int InitialHeight = lua_gettop(State);
 #endif
+	lua_pushlightuserdata(State, TypeUID);
+	lua_rawget(State, LUA_REGISTRYINDEX);
+	if (lua_isnil(State, -1))
+	{
+		lua_pop(State, 1);
 		lua_newtable(State);
+		lua_pushlightuserdata(State, TypeUID);
+		lua_pushvalue(State, -2);
+		lua_rawset(State, LUA_REGISTRYINDEX);
+	}
+#ifndef NDEBUG
+	assert((unsigned int)lua_gettop(State) == InitialHeight + 1);
+#endif
+}
 
-		lua_pushstring(State, "_data");
-		lua_pushlightuserdata(State, Value);
-		lua_settable(State, -3);
+//-- Lazy method tables
+// A lazy method table starts out empty, with a metatable whose __index fills it (the parent's methods, then the
+// populator's) on the first lookup and then removes itself.  States only build the method tables they use.
+typedef void (*MethodPopulator)(lua_State *State);
 
-		lua_pushstring(State, "_type");
-		lua_pushstring(State, typeid(Type *).name());
-		lua_settable(State, -3);
+inline void CopyMethods(lua_State *State, UID ParentUID);
 
-		SetMetatable(State, TypeUID);
-#ifndef NDEBUG
-		assert((unsigned int)lua_gettop(State) == InitialHeight + 1);
-		assert(lua_istable(State, -1));
-#endif
+// Fills the method table at Methods if it is still waiting to be populated
+inline void PopulateMethods(lua_State *State, int Methods)
+{
+	Methods = lua_absindex(State, Methods);
+	if (!lua_getmetatable(State, Methods)) return;
+	lua_pushstring(State, "populator");
+	lua_rawget(State, -2);
+	MethodPopulator Populator = *static_cast<MethodPopulator *>(lua_touserdata(State, -1));
+	lua_pushstring(State, "parent");
+	lua_rawget(State, -3);
+	UID ParentUID = static_cast<UID>(lua_touserdata(State, -1));
+	lua_pop(State, 3);
+
+	lua_pushnil(State);
+	lua_setmetatable(State, Methods);
+	lua_pushvalue(State, Methods);
+	if (ParentUID != nullptr) CopyMethods(State, ParentUID);
+	Populator(State);
+	lua_pop(State, 1);
+}
+
+inline int LookUpLazyMethod(lua_State *State)
+{
+	PopulateMethods(State, 1);
+	lua_rawget(State, 1);
+	return 1;
+}
+
+// Copies the methods of ParentUID's method table into the table on top of the stack.  The same function values are
+// used, so no closures are created.
+inline void CopyMethods(lua_State *State, UID ParentUID)
+{
+	PushMetatable(State, ParentUID);
+	lua_pushstring(State, "__index");
+	lua_rawget(State, -2);
+	assert(lua_istable(State, -1));
+	PopulateMethods(State, -1);
+	lua_pushnil(State);
+	while (lua_next(State, -2) != 0)
+	{
+		lua_pushvalue(State, -2);
+		lua_insert(State, -2);
+		lua_rawset(State, -6);
 	}
-};
+	lua_pop(State, 2);
+}
 
-//-- Metatable tools
-template <typename PopulatorType> void CreateMetatable(lua_State *State, UID TypeUID, PopulatorType const &Populator)
+// Subtypes start with the parent's methods and the populator only adds or overrides the subtype's own.  The parent's
+// metatable must have been created already.
+template <typename PopulatorType> void CreateMetatable(lua_State *State, UID TypeUID, UID ParentUID, PopulatorType const &Populator)
 {
 #ifndef NDEBUG
 	unsigned int const InitialHeight = lua_gettop(State);
 #endif
 	// Create method table
 	lua_newtable(State);
+	if (ParentUID != nullptr) CopyMethods(State, ParentUID);
 	Populator();
 
-	// Create metatable that points to method table
-	lua_pushlightuserdata(State, TypeUID);
+	// Point metatable at method table
+	PushMetatable(State, TypeUID);
+	lua_pushstring(State, "__index");
+	lua_pushvalue(State, -3);
+	lua_settable(State, -3);
+
+	// Pop metatable and extra reference to method table
+	lua_pop(State, 2);
+#ifndef NDEBUG
+	assert((unsigned int)lua_gettop(State) == InitialHeight);
+#endif
+}
+
+template <typename PopulatorType> void CreateMetatable(lua_State *State, UID TypeUID, PopulatorType const &Populator)
+	{ CreateMetatable(State, TypeUID, nullptr, Populator); }
+
+// Like CreateMetatable, but the method table is populated on first use.  The populator is called with the method
+// table on top of the stack.
+inline void CreateLazyMetatable(lua_State *State, UID TypeUID, UID ParentUID, MethodPopulator Populator)
+{
+#ifndef NDEBUG
+	unsigned int const InitialHeight = lua_gettop(State);
+#endif
 	lua_newtable(State);
+	lua_createtable(State, 0, 3);
+	lua_pushstring(State, "__index");
+	lua_pushcfunction(State, LookUpLazyMethod);
+	lua_rawset(State, -3);
+	lua_pushstring(State, "populator");
+	*static_cast<MethodPopulator *>(lua_newuserdata(State, sizeof(MethodPopulator))) = Populator;
+	lua_rawset(State, -3);
+	if (ParentUID != nullptr)
+	{
+		lua_pushstring(State, "parent");
+		lua_pushlightuserdata(State, ParentUID);
+		lua_rawset(State, -3);
+	}
+	lua_setmetatable(State, -2);
+
+	PushMetatable(State, TypeUID);
 	lua_pushstring(State, "__index");
-	lua_pushvalue(State, -4);
+	lua_pushvalue(State, -3);
 	lua_settable(State, -3);
-	lua_settable(State, LUA_REGISTRYINDEX);
+	lua_pop(State, 2);
+#ifndef NDEBUG
+	assert((unsigned int)lua_gettop(State) == InitialHeight);
+#endif
+}
+
+inline void CreateLazyMetatable(lua_State *State, UID TypeUID, MethodPopulator Populator)
+	{ CreateLazyMetatable(State, TypeUID, nullptr, Populator); }
+
+//-- Enums
+// Enum values live in static arrays shared by every state.  An enum table starts empty and its __index looks names up
+// in the array, caching what it finds in the table.
+struct EnumValue
+{
+	char const *Name;
+	int Value;
+};
+
+inline int LookUpEnumValue(lua_State *State)
+{
+	// Closure data
+	// 1 is the value array, 2 the value count
+	if (lua_type(State, 2) != LUA_TSTRING) return 0;
+	char const *Key = lua_tostring(State, 2);
+	EnumValue const *Values = static_cast<EnumValue const *>(lua_touserdata(State, lua_upvalueindex(1)));
+	lua_Integer const Count = lua_tointeger(State, lua_upvalueindex(2));
+	for (lua_Integer Index = 0; Index < Count; ++Index)
+	{
+		if (strcmp(Values[Index].Name, Key) != 0) continue;
+		lua_settop(State, 2);
+		lua_pushinteger(State, Values[Index].Value);
+		lua_pushvalue(State, -1);
+		lua_insert(State, 2);
+		lua_rawset(State, 1);
+		return 1;
+	}
+	return 0;
+}
+
+inline int IterateEnum(lua_State *State)
+{
+	// Fills the table so pairs sees every value
+	EnumValue const *Values = static_cast<EnumValue const *>(lua_touserdata(State, lua_upvalueindex(1)));
+	lua_Integer const Count = lua_tointeger(State, lua_upvalueindex(2));
+	for (lua_Integer Index = 0; Index < Count; ++Index)
+	{
+		lua_pushstring(State, Values[Index].Name);
+		lua_pushinteger(State, Values[Index].Value);
+		lua_rawset(State, 1);
+	}
+	lua_getglobal(State, "next");
+	lua_pushvalue(State, 1);
+	lua_pushnil(State);
+	return 3;
+}
+
+inline void PushEnumTable(lua_State *State, EnumValue const *Values, size_t Count)
+{
+#ifndef NDEBUG
+	unsigned int const InitialHeight = lua_gettop(State);
+#endif
+	lua_newtable(State);
+	lua_createtable(State, 0, 2);
+	lua_pushstring(State, "__index");
+	lua_pushlightuserdata(State, const_cast<EnumValue *>(Values));
+	lua_pushinteger(State, Count);
+	lua_pushcclosure(State, LookUpEnumValue, 2);
+	lua_rawset(State, -3);
+	lua_pushstring(State, "__pairs");
+	lua_pushlightuserdata(State, const_cast<EnumValue *>(Values));
+	lua_pushinteger(State, Count);
+	lua_pushcclosure(State, IterateEnum, 2);
+	lua_rawset(State, -3);
+	lua_setmetatable(State, -2);
+#ifndef NDEBUG
+	assert((unsigned int)lua_gettop(State) == InitialHeight + 1);
+#endif
+}
 
-	// Pop extra reference to method table
+// Sets the field Name of the table on top of the stack to an enum table for Values
+template <size_t Count> void RegisterEnum(lua_State *State, char const *Name, EnumValue const (&Values)[Count])
+{
+#ifndef NDEBUG
+	lua_pushstring(State, Name);
+	lua_rawget(State, -2);
+	assert(lua_isnil(State, -1));
 	lua_pop(State, 1);
+	unsigned int const InitialHeight = lua_gettop(State);
+#endif
+	lua_pushstring(State, Name);
+	PushEnumTable(State, Values, Count);
+	lua_settable(State, -3);
 #ifndef NDEBUG
 	assert((unsigned int)lua_gettop(State) == InitialHeight);
 #endif
 }
 
-inline void SetMetatable(lua_State *State, UID TypeUID)
+//-- Lazy fields
+// Fields of a module table created on first access.  Each entry names a field and the loader that creates it; a
+// loader is called with the module table on top of the stack and may create several fields at once, so the entries
+// for a group of related fields can share one loader.  Enum tables are listed separately, with their values.
+struct LazyField
+{
+	char const *Name;
+	void (*Loader)(lua_State *State);
+};
+
+struct LazyEnum
+{
+	char const *Name;
+	EnumValue const *Values;
+	size_t Count;
+};
+
+template <size_t Count> constexpr LazyEnum MakeLazyEnum(char const *Name, EnumValue const (&Values)[Count])
+	{ return LazyEnum{Name, Values, Count}; }
+
+inline int LoadLazyField(lua_State *State)
+{
+	// Closure data
+	// 1 is the field array, 2 the field count, 3 the enum array, 4 the enum count
+	if (lua_type(State, 2) != LUA_TSTRING) return 0;
+	char const *Key = lua_tostring(State, 2);
+	LazyField const *Fields = static_cast<LazyField const *>(lua_touserdata(State, lua_upvalueindex(1)));
+	lua_Integer const FieldCount = lua_tointeger(State, lua_upvalueindex(2));
+	for (lua_Integer Index = 0; Index < FieldCount; ++Index)
+	{
+		if (strcmp(Fields[Index].Name, Key) != 0) continue;
+		lua_settop(State, 2);
+		lua_pushvalue(State, 1);
+		Fields[Index].Loader(State);
+		lua_pop(State, 1);
+		lua_rawget(State, 1);
+		return 1;
+	}
+
+	LazyEnum const *Enums = static_cast<LazyEnum const *>(lua_touserdata(State, lua_upvalueindex(3)));
+	lua_Integer const EnumCount = lua_tointeger(State, lua_upvalueindex(4));
+	for (lua_Integer Index = 0; Index < EnumCount; ++Index)
+	{
+		if (strcmp(Enums[Index].Name, Key) != 0) continue;
+		lua_settop(State, 2);
+		PushEnumTable(State, Enums[Index].Values, Enums[Index].Count);
+		lua_pushvalue(State, -1);
+		lua_insert(State, 2);
+		lua_rawset(State, 1);
+		return 1;
+	}
+	return 0;
+}
+
+// Gives the table on top of the stack a metatable that creates Fields and Enums on demand
+template <size_t FieldCount, size_t EnumCount> void SetLazyFields(lua_State *State, LazyField const (&Fields)[FieldCount], LazyEnum const (&Enums)[EnumCount])
 {
 #ifndef NDEBUG
-	unsigned int InitialHeight = lua_gettop(State);
+	unsigned int const InitialHeight = lua_gettop(State);
 #endif
-	lua_pushlightuserdata(State, TypeUID);
-	lua_gettable(State, LUA_REGISTRYINDEX);
-	assert(!lua_isnil(State, -1)); // No metatable for this UUID
+	lua_createtable(State, 0, 1);
+	lua_pushstring(State, "__index");
+	lua_pushlightuserdata(State, const_cast<LazyField *>(Fields));
+	lua_pushinteger(State, FieldCount);
+	lua_pushlightuserdata(State, const_cast<LazyEnum *>(Enums));
+	lua_pushinteger(State, EnumCount);
+	lua_pushcclosure(State, LoadLazyField, 4);
+	lua_rawset(State, -3);
 	lua_setmetatable(State, -2);
 #ifndef NDEBUG
 	assert((unsigned int)lua_gettop(State) == InitialHeight);
 #endif
 }
 
+// Populates the metatable itself, for metamethods
+template <typename PopulatorType> void ExtendMetatable(lua_State *State, UID TypeUID, PopulatorType const &Populator)
+{
+#ifndef NDEBUG
+	unsigned int const InitialHeight = lua_gettop(State);
+#endif
+	PushMetatable(State, TypeUID);
+	Populator();
+	lua_pop(State, 1);
+#ifndef NDEBUG
+	assert((unsigned int)lua_gettop(State) == InitialHeight);
+#endif
+}
+
 namespace MetatableGarbageCollector
 {
 	template <typename FunctionType, FunctionType Function> struct DeleterCallback {};
@@ -291,9 +705,7 @@ namespace MetatableGarbageCollector
 #ifndef NDEBUG
 		unsigned int InitialHeight = lua_gettop(State);
 #endif
-		lua_pushlightuserdata(State, TypeUID);
-		lua_gettable(State, LUA_REGISTRYINDEX);
-		assert(!lua_isnil(State, -1)); // No metatable for this UUID
+		PushMetatable(State, TypeUID);
 
 		lua_pushstring(State, "__gc");
 		lua_pushcfunction(State, (DeleterCallback<FunctionType, Function>::Callback));
@@ -312,13 +724,21 @@ namespace MetatableGarbageCollector
 namespace SingleReturn
 {
 	//-- Regular function registration
+	// Arguments are read one per step, front to back.  Once only doubles remain (line_to, curve_to, rectangle, ...) they
+	// are all read in a single loop instead.
+	template <typename Types> struct AllDoubles { static constexpr bool Value = false; };
+	template <> struct AllDoubles<std::tuple<double> > { static constexpr bool Value = true; };
+	template <typename... OtherTypes> struct AllDoubles<std::tuple<double, double, OtherTypes...> > 
+		{ static constexpr bool Value = AllDoubles<std::tuple<double, OtherTypes...> >::Value; };
+
 	template 
 	<
 		typename FunctionType, 
 		FunctionType *Function,
 		typename ReturnType,
 		typename UnreadTypes,
-		typename ReadTypes
+		typename ReadTypes,
+		bool DoublesOnly = AllDoubles<UnreadTypes>::Value
 	> struct CallWrapper {};
 	
 	template 
@@ -336,7 +756,7 @@ namespace SingleReturn
 		typename UnreadType, 
 		typename... OtherUnreadTypes, 
 		typename... ReadTypes
-	> struct CallWrapper<FunctionType, Function, ReturnType, std::tuple<UnreadType, OtherUnreadTypes...>, std::tuple<ReadTypes...> >
+	> struct CallWrapper<FunctionType, Function, ReturnType, std::tuple<UnreadType, OtherUnreadTypes...>, std::tuple<ReadTypes...>, false>
 	{
 		static ReturnType Call(lua_State *State, int Position, ReadTypes... ReadValues)
 		{
@@ -345,13 +765,35 @@ namespace SingleReturn
 		}
 	};
 
+	template 
+	<
+		typename FunctionType,
+		FunctionType *Function,	
+		typename ReturnType, 
+		typename... UnreadTypes, 
+		typename... ReadTypes
+	> struct CallWrapper<FunctionType, Function, ReturnType, std::tuple<UnreadTypes...>, std::tuple<ReadTypes...>, true>
+	{
+		static ReturnType Call(lua_State *State, int Position, ReadTypes... ReadValues)
+		{
+			double Values[sizeof...(UnreadTypes)];
+			ReadDoubles(State, Position, Values, sizeof...(UnreadTypes));
+			return Apply(typename MakeIndexSequence<sizeof...(UnreadTypes)>::Type(), Values, ReadValues...);
+		}
+
+		template <size_t... Indices> static ReturnType Apply(IndexSequence<Indices...>, double const *Values, ReadTypes... ReadValues)
+		{
+			return Function(ReadValues..., Values[Indices]...);
+		}
+	};
+
 	template
 	<
 		typename FunctionType,
 		FunctionType *Function,
 		typename ReturnType,
 		typename... ReadTypes
-	> struct CallWrapper<FunctionType, Function, ReturnType, std::tuple<>, std::tuple<ReadTypes...> >
+	> struct CallWrapper<FunctionType, Function, ReturnType, std::tuple<>, std::tuple<ReadTypes...>, false>
 	{
 		static ReturnType Call(lua_State *, int, ReadTypes... ReadValues)
 		{
@@ -366,20 +808,15 @@ namespace SingleReturn
 		ReturnType (*Function)(ArgumentTypes...)
 	> struct RegistrationCallback<ReturnType(ArgumentTypes...), Function>
 	{
+		static constexpr bool ReturnsObject = IsObject<ReturnType>::Value;
+
 		static int Callback(lua_State *State)
 		{	
 			// Closure data
-			// 1 is an override for return table metadata uid, if applicable (use bound function otherwise)
+			// 1 is the metatable for returned objects, if the return type is an object
 			typedef ReturnType (FunctionType)(ArgumentTypes...);
 			ReturnType ReturnValue = CallWrapper<FunctionType, Function, ReturnType, std::tuple<ArgumentTypes...>, std::tuple<> >::Call(State, 1);
-
-			UID TypeUID;
-			if (lua_isuserdata(State, lua_upvalueindex(1)))
-				TypeUID = (UID)lua_touserdata(State, lua_upvalueindex(1));
-			//else TypeUID = AsUID(Function); // Crashes on g++-4.8 git right now
-			else TypeUID = (UID)Function;
-			//else TypeUID = 0; // DON'T USE.  You will know to use this when the time is right.
-			LuaValue<ReturnType>::Write(State, TypeUID, ReturnValue);
+			LuaValue<ReturnType>::Write(State, lua_upvalueindex(1), ReturnValue);
 			return 1;
 		}
 	};
@@ -391,6 +828,8 @@ namespace SingleReturn
 		void (*Function)(ArgumentTypes...)
 	> struct RegistrationCallback<void(ArgumentTypes...), Function>
 	{
+		static constexpr bool ReturnsObject = false;
+
 		static int Callback(lua_State *State)
 		{
 			CallWrapper<void(ArgumentTypes...), Function, void, std::tuple<ArgumentTypes...>, std::tuple<> >::Call(State, 1);
@@ -409,11 +848,11 @@ namespace SingleReturn
 #endif
 		lua_pushstring(State, Name);
 		int ClosureDataCount = 0;
-		if (ReturnTypeUID != nullptr) 
+		if (RegistrationCallback<FunctionType, Function>::ReturnsObject) 
 		{
-			//assert(typeid(std::declval<FunctionType>()) != typeid(void));
-			// This is used to override the metatable associated with returned objects (or pointers to)
-			lua_pushlightuserdata(State, ReturnTypeUID);
+			// Bind the metatable for returned objects so wrapping doesn't need a registry lookup
+			assert(ReturnTypeUID != nullptr);
+			PushMetatable(State, ReturnTypeUID);
 			ClosureDataCount += 1;
 		}
 		lua_pushcclosure(State, RegistrationCallback<FunctionType, Function>::Callback, ClosureDataCount);
@@ -429,8 +868,24 @@ namespace MultipleReturn
 {
 	// The outputs must be handled in reverse order so that they are pushed to the lua stack in the correct order.
 	// This also lets us optimistically handle input/output functions (pointer arguments used for input and output)
-	// -- Arguments are read (if available) in reverse order from the top of the stack and initialize the output storage
-	// Note: Output/IO parameters are reversed using the ReverseTuple type above, so all further processing is actually in reverse order (back to front).
+	// -- Arguments are read (if available) from their own stack positions, counting down from the last argument, and initialize the output storage
+	// Results are pushed above the arguments so the caller's stack is left alone; the callback reserves the slots up front.
+	// Note: Output/IO parameters are accumulated back to front, so all further processing is actually in reverse order.
+	template <typename FunctionType> struct Signature {};
+
+	template 
+	<
+		typename FunctionReturnType,
+		typename FunctionInputType,
+		typename... FunctionOutputTypes
+	> struct Signature<FunctionReturnType(FunctionInputType, FunctionOutputTypes...)>
+	{
+		typedef FunctionReturnType ReturnType;
+		typedef FunctionInputType InputType;
+		typedef std::tuple<FunctionOutputTypes...> OutputTypes;
+		static constexpr int ResultCount = sizeof...(FunctionOutputTypes) + (std::is_void<FunctionReturnType>::value ? 0 : 1);
+	};
+
 	template 
 	<
 		bool Initialize, 
@@ -441,13 +896,6 @@ namespace MultipleReturn
 		typename UnallocatedTypes, 
 		typename OutputTypes 
 	> struct CallWrapper {};
-	
-	template 
-	<
-		bool Initialize, 
-		typename FunctionType, 
-		FunctionType *Function
-	> struct RegistrationCallback {};
 
 	template 
 	<
@@ -468,15 +916,12 @@ namespace MultipleReturn
 		std::tuple<UnallocatedType *, UnallocatedTypes...>, 
 		std::tuple<OutputTypes...> > 
 	{
-		static unsigned int Call(lua_State *State, InputType const &Input, unsigned int Count, OutputTypes... AllocatedPointers)
+		static int Call(lua_State *State, InputType const &Input, int Position, OutputTypes... AllocatedPointers)
 		{
-			UnallocatedType Storage;
+			UnallocatedType Storage = UnallocatedType();
 			if (Initialize)
-			{
-				Storage = LuaValue<UnallocatedType>::Read(State, -1);
-				lua_pop(State, 1);
-			}
-			unsigned int Read = CallWrapper<
+				Storage = LuaValue<UnallocatedType>::Read(State, Position);
+			int Count = CallWrapper<
 				Initialize,
 				FunctionType, 
 				Function,
@@ -484,9 +929,9 @@ namespace MultipleReturn
 				InputType,
 				std::tuple<UnallocatedTypes...>, 
 				std::tuple<UnallocatedType *, OutputTypes...> 
-				>::Call(State, Input, Count + 1, &Storage, AllocatedPointers...);
-			LuaValue<UnallocatedType>::Write(State, nullptr, Storage);
-			return Read;
+				>::Call(State, Input, Position - 1, &Storage, AllocatedPointers...);
+			LuaValue<UnallocatedType>::Write(State, 0, Storage);
+			return Count + 1;
 		}
 	};
 
@@ -508,38 +953,14 @@ namespace MultipleReturn
 		std::tuple<>, 
 		std::tuple<OutputTypes...> >
 	{
-		static unsigned int Call(lua_State *State, InputType const &Input, unsigned int Count, OutputTypes... AllocatedPointers)
+		static int Call(lua_State *State, InputType const &Input, int, OutputTypes... AllocatedPointers)
 		{
 			ReturnType Return = Function(Input, AllocatedPointers...);
-			lua_settop(State, 0);
-			LuaValue<ReturnType>::Write(State, nullptr, Return);
-			return 1 + Count;
+			LuaValue<ReturnType>::Write(State, 0, Return);
+			return 1;
 		}
 	};
 
-	template 
-	<
-		bool Initialize, 
-		typename ReturnType,
-		typename InputType, 
-		typename... OutputTypes,
-		ReturnType (*Function)(InputType, OutputTypes...)
-	> struct RegistrationCallback<Initialize, ReturnType(InputType, OutputTypes...), Function>
-	{
-		static int Callback(lua_State *State)
-		{
-			InputType Input = LuaValue<InputType>::Read(State, 1);
-			return CallWrapper<
-				Initialize, 
-				ReturnType(InputType, OutputTypes...),
-				Function,	
-				ReturnType, 
-				InputType, 
-				std::tuple<OutputTypes...>, 
-				std::tuple<> >::Call(State, Input, 0);
-		}
-	};
-	
 	// Void return type specializations
 	template
 	<
@@ -557,33 +978,73 @@ namespace MultipleReturn
 		std::tuple<>, 
 		std::tuple<OutputTypes...> >
 	{
-		static unsigned int Call(lua_State *State, InputType const &Input, unsigned int Count, OutputTypes... AllocatedPointers)
+		static int Call(lua_State *, InputType const &Input, int, OutputTypes... AllocatedPointers)
 		{
 			Function(Input, AllocatedPointers...);
-			lua_settop(State, 0);
-			return Count;
+			return 0;
 		}
 	};
 
 	template 
 	<
 		bool Initialize, 
-		typename InputType, 
-		typename... OutputTypes,
-		void (*Function)(InputType, OutputTypes...)
-	> struct RegistrationCallback<Initialize, void (*)(InputType, OutputTypes...), Function>
+		typename FunctionType, 
+		FunctionType *Function
+	> struct RegistrationCallback
 	{
-		static int Callback(lua_State *State)
+		typedef Signature<FunctionType> Types;
+
+		// Pushes the results, returns the count
+		static int Call(lua_State *State, typename Types::InputType const &Input)
 		{
-			InputType Input = LuaValue<InputType>::Read(State, 1);
 			return CallWrapper<
 				Initialize, 
-				void(InputType, OutputTypes...),
-				Function,
-				void, 
-				InputType, 
-				std::tuple<OutputTypes...>, 
-				std::tuple<> >::Call(State, Input, 0);
+				FunctionType,
+				Function,	
+				typename Types::ReturnType, 
+				typename Types::InputType, 
+				typename Types::OutputTypes, 
+				std::tuple<> >::Call(State, Input, 1 + std::tuple_size<typename Types::OutputTypes>::value);
+		}
+
+		static int Callback(lua_State *State)
+		{
+			typename Types::InputType Input = LuaValue<typename Types::InputType>::Read(State, 1);
+			luaL_checkstack(State, Types::ResultCount, "Not enough stack space for results.");
+			return Call(State, Input);
+		}
+	};
+
+	// Calls several multiple return functions with the same signature on one input and returns all of their results
+	template 
+	<
+		typename FunctionType, 
+		FunctionType *... Functions
+	> struct Bundle
+	{
+		static int Call(lua_State *, typename Signature<FunctionType>::InputType const &) { return 0; }
+	};
+
+	template 
+	<
+		typename FunctionType, 
+		FunctionType *Function,
+		FunctionType *... OtherFunctions
+	> struct Bundle<FunctionType, Function, OtherFunctions...>
+	{
+		typedef Signature<FunctionType> Types;
+
+		static int Call(lua_State *State, typename Types::InputType const &Input)
+		{
+			int Count = RegistrationCallback<false, FunctionType, Function>::Call(State, Input);
+			return Count + Bundle<FunctionType, OtherFunctions...>::Call(State, Input);
+		}
+
+		static int Callback(lua_State *State)
+		{
+			typename Types::InputType Input = LuaValue<typename Types::InputType>::Read(State, 1);
+			luaL_checkstack(State, Types::ResultCount * (1 + sizeof...(OtherFunctions)), "Not enough stack space for results.");
+			return Call(State, Input);
 		}
 	};
 
@@ -601,6 +1062,20 @@ namespace MultipleReturn
 		lua_settable(State, -3);
 #ifndef NDEBUG
 		assert((unsigned int)lua_gettop(State) == InitialHeight);
+#endif
+	}
+
+	template <typename FunctionType, FunctionType *... Functions> void RegisterBundleInternal(lua_State *State, char const *Name)
+	{
+		// Registers a function returning the results of all of Functions, in order
+#ifndef NDEBUG
+		unsigned int const InitialHeight = lua_gettop(State);
+#endif
+		lua_pushstring(State, Name);
+		lua_pushcfunction(State, (Bundle<FunctionType, Functions...>::Callback));
+		lua_settable(State, -3);
+#ifndef NDEBUG
+		assert((unsigned int)lua_gettop(State) == InitialHeight);
 #endif
 	}
 }
@@ -625,28 +1100,28 @@ namespace InputOutput
 	}
 }
 
-// Enumeration registration
-void RegisterEnum(lua_State *State, std::string const &Name, std::initializer_list<std::pair<std::string, int> > Values)
+namespace Raw
 {
+	inline void RegisterInternal(lua_State *State, char const *Name, lua_CFunction Function, UID ReturnTypeUID = nullptr)
+	{
+		// Registers a function that does its own stack handling.
+		// If a metatable is specified it is bound as upvalue 1, as for single return functions.
 #ifndef NDEBUG
-	lua_pushstring(State, Name.c_str());
-	lua_gettable(State, -2);
-	assert(lua_isnil(State, -1));
-	lua_pop(State, 1);
-	unsigned int const InitialHeight = lua_gettop(State);
+		unsigned int const InitialHeight = lua_gettop(State);
 #endif
-	lua_pushstring(State, Name.c_str());
-	lua_createtable(State, 0, Values.size());
-	for (auto const &Value : Values)
-	{
-		lua_pushstring(State, Value.first.c_str());
-		lua_pushnumber(State, Value.second);
+		lua_pushstring(State, Name);
+		int ClosureDataCount = 0;
+		if (ReturnTypeUID != nullptr)
+		{
+			PushMetatable(State, ReturnTypeUID);
+			ClosureDataCount += 1;
+		}
+		lua_pushcclosure(State, Function, ClosureDataCount);
 		lua_settable(State, -3);
-	}
-	lua_settable(State, -3);
 #ifndef NDEBUG
-	assert((unsigned int)lua_gettop(State) == InitialHeight);
+		assert((unsigned int)lua_gettop(State) == InitialHeight);
 #endif
+	}
 }
 
 // Usability macros
@@ -657,6 +1132,8 @@ void RegisterEnum(lua_State *State, std::string const &Name, std::initializer_li
 
 #define RegisterMultipleReturn(State, Name, Function) \
 	MultipleReturn::RegisterInternal<decltype(Function), Function>(State, Name) 
+#define RegisterMultipleReturnBundle(State, Name, Function, ...) \
+	MultipleReturn::RegisterBundleInternal<decltype(Function), Function, __VA_ARGS__>(State, Name) 
 //#define RegisterMultipleReturnWithMetatable(State, Name, Function, Metatable) \
 //	MultipleReturn::RegisterInternal<decltype(&Function), Function>(State, Name, Metatable) 
 
@@ -665,5 +1142,10 @@ void RegisterEnum(lua_State *State, std::string const &Name, std::initializer_li
 //#define RegisterInputOutputWithMetatable(State, Name, Function, Metatable) \
 //	InputOutput::RegisterInternal<decltype(&Function), Function>(State, Name, Metatable) 
 
+#define RegisterLuaFunction(State, Name, Function) \
+	Raw::RegisterInternal(State, Name, Function)
+#define RegisterLuaFunctionWithMetatable(State, Name, Function, Metatable) \
+	Raw::RegisterInternal(State, Name, Function, Metatable)
+
 #endif
 
@@ -0,0 +1,156 @@
+#ifndef path_h
+#define path_h
+
+#include <cstdlib>
+#include <algorithm>
+
+#include "library.h"
+
+// Batched path construction
+// Points and coordinates are flat x, y sequences or packed strings of doubles.
+template <bool Close> int BuildPolyline(lua_State *State)
+{
+	cairo_t *Context = LuaValue<cairo_t *>::Read(State, 1);
+	PackedArray<double> Points(State, 2);
+	if (Points.Count % 2 != 0)
+		return luaL_error(State, "Parameter 2 must contain x, y pairs, but it has %d values.", (int)Points.Count);
+	if (Points.Count == 0) return 0;
+
+	cairo_move_to(Context, Points.Data[0], Points.Data[1]);
+	for (size_t Index = 2; Index < Points.Count; Index += 2)
+		cairo_line_to(Context, Points.Data[Index], Points.Data[Index + 1]);
+	if (Close) cairo_close_path(Context);
+	return 0;
+}
+
+inline int PathCoordinateCount(int Operation)
+{
+	switch (Operation)
+	{
+		case CAIRO_PATH_MOVE_TO: return 2;
+		case CAIRO_PATH_LINE_TO: return 2;
+		case CAIRO_PATH_CURVE_TO: return 6;
+		case CAIRO_PATH_CLOSE_PATH: return 0;
+		default: return -1;
+	}
+}
+
+// Checks that each operation has its coordinates and returns the number of cairo_path_data_t elements they make up
+inline int CheckPathArrays(lua_State *State, PackedArray<unsigned char> const &Operations, PackedArray<double> const &Coordinates)
+{
+	size_t Used = 0;
+	int DataCount = 0;
+	for (size_t Index = 0; Index < Operations.Count; ++Index)
+	{
+		int Needed = PathCoordinateCount(Operations.Data[Index]);
+		if (Needed < 0)
+			return luaL_error(State, "Path operation %d is not a valid cairo.path value.", (int)Index + 1);
+		if (Coordinates.Count - Used < (size_t)Needed)
+			return luaL_error(State, "Path operation %d needs more coordinates than were given.", (int)Index + 1);
+		Used += Needed;
+		DataCount += 1 + Needed / 2;
+	}
+	if (Used != Coordinates.Count)
+		return luaL_error(State, "%d path coordinates were left over after the last operation.", (int)(Coordinates.Count - Used));
+	return DataCount;
+}
+
+static int BuildPath(lua_State *State)
+{
+	// Operations are cairo.path values; each consumes its points from the coordinate array in order.
+	cairo_t *Context = LuaValue<cairo_t *>::Read(State, 1);
+	PackedArray<unsigned char> Operations(State, 2);
+	PackedArray<double> Coordinates(State, 3);
+	CheckPathArrays(State, Operations, Coordinates);
+
+	double const *Next = Coordinates.Data;
+	for (size_t Index = 0; Index < Operations.Count; ++Index)
+	{
+		switch (Operations.Data[Index])
+		{
+			case CAIRO_PATH_MOVE_TO: cairo_move_to(Context, Next[0], Next[1]); break;
+			case CAIRO_PATH_LINE_TO: cairo_line_to(Context, Next[0], Next[1]); break;
+			case CAIRO_PATH_CURVE_TO: cairo_curve_to(Context, Next[0], Next[1], Next[2], Next[3], Next[4], Next[5]); break;
+			case CAIRO_PATH_CLOSE_PATH: cairo_close_path(Context); break;
+		}
+		Next += PathCoordinateCount(Operations.Data[Index]);
+	}
+	return 0;
+}
+
+// Path objects
+// cairo.packedpath(operations, coordinates) builds a path from the same arrays pathcommands takes, for appendpath.
+// path:getoperations() and path:getcoordinates() return a path's contents in that form: a string with one cairo.path
+// value per byte and a buffer of coordinates.
+static int CreatePackedPath(lua_State *State)
+{
+	PackedArray<unsigned char> Operations(State, 1);
+	PackedArray<double> Coordinates(State, 2);
+	int const DataCount = CheckPathArrays(State, Operations, Coordinates);
+
+	// Allocated the way cairo does, so cairo_path_destroy can free it
+	cairo_path_t *Path = static_cast<cairo_path_t *>(malloc(sizeof(cairo_path_t)));
+	cairo_path_data_t *Data = static_cast<cairo_path_data_t *>(malloc(sizeof(cairo_path_data_t) * std::max(DataCount, 1)));
+	if ((Path == nullptr) || (Data == nullptr))
+	{
+		free(Path);
+		free(Data);
+		return luaL_error(State, "Not enough memory for the path.");
+	}
+	Path->status = CAIRO_STATUS_SUCCESS;
+	Path->data = Data;
+	Path->num_data = DataCount;
+
+	double const *Next = Coordinates.Data;
+	for (size_t Index = 0; Index < Operations.Count; ++Index)
+	{
+		int const PointCount = PathCoordinateCount(Operations.Data[Index]) / 2;
+		Data->header.type = static_cast<cairo_path_data_type_t>(Operations.Data[Index]);
+		Data->header.length = 1 + PointCount;
+		++Data;
+		for (int Point = 0; Point < PointCount; ++Point, ++Data, Next += 2)
+		{
+			Data->point.x = Next[0];
+			Data->point.y = Next[1];
+		}
+	}
+
+	LuaValue<cairo_path_t *>::Write(State, lua_upvalueindex(1), Path);
+	return 1;
+}
+
+static int GetPathOperations(lua_State *State)
+{
+	cairo_path_t *Path = LuaValue<cairo_path_t *>::Read(State, 1);
+	luaL_Buffer Operations;
+	luaL_buffinit(State, &Operations);
+	for (int Index = 0; Index < Path->num_data; Index += Path->data[Index].header.length)
+		luaL_addchar(&Operations, (char)Path->data[Index].header.type);
+	luaL_pushresult(&Operations);
+	return 1;
+}
+
+static int GetPathCoordinates(lua_State *State)
+{
+	cairo_path_t *Path = LuaValue<cairo_path_t *>::Read(State, 1);
+	size_t Count = 0;
+	for (int Index = 0; Index < Path->num_data; Index += Path->data[Index].header.length)
+		Count += 2 * (Path->data[Index].header.length - 1);
+
+	double *Next = PushDoubleBuffer(State, lua_upvalueindex(1), Count)->Data;
+	for (int Index = 0; Index < Path->num_data; Index += Path->data[Index].header.length)
+		for (int Point = 1; Point < Path->data[Index].header.length; ++Point)
+		{
+			*Next++ = Path->data[Index + Point].point.x;
+			*Next++ = Path->data[Index + Point].point.y;
+		}
+	return 1;
+}
+
+static int GetPathStatus(lua_State *State)
+{
+	lua_pushinteger(State, LuaValue<cairo_path_t *>::Read(State, 1)->status);
+	return 1;
+}
+
+#endif
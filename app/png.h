@@ -0,0 +1,258 @@
+#ifndef png_h
+#define png_h
+
+#include <cstdlib>
+#include <algorithm>
+
+#include "library.h"
+
+#ifdef CAIRO_HAS_PNG_FUNCTIONS
+// PNG streams
+// Output is staged in a growable buffer kept per Lua state, so repeated encodes reuse the same allocation.  A call
+// made while the buffer is taken (from a stream callback) gets a buffer of its own.
+struct PNGBuffer
+{
+	unsigned char *Data;
+	size_t Size;
+	size_t Capacity;
+	bool Taken;
+};
+
+static UIDObject PNGBufferKey;
+
+static int DestroyPNGBuffer(lua_State *State)
+{
+	PNGBuffer *Buffer = static_cast<PNGBuffer *>(lua_touserdata(State, 1));
+	free(Buffer->Data);
+	Buffer->Data = nullptr;
+	return 0;
+}
+
+inline PNGBuffer *PushPNGBuffer(lua_State *State)
+{
+	PNGBuffer *Buffer = static_cast<PNGBuffer *>(lua_newuserdata(State, sizeof(PNGBuffer)));
+	Buffer->Data = nullptr;
+	Buffer->Size = 0;
+	Buffer->Capacity = 0;
+	Buffer->Taken = false;
+	lua_newtable(State);
+	lua_pushstring(State, "__gc");
+	lua_pushcfunction(State, DestroyPNGBuffer);
+	lua_settable(State, -3);
+	lua_setmetatable(State, -2);
+	return Buffer;
+}
+
+// Returns an empty buffer that must be given back with ReturnPNGBuffer, including before raising errors.  If the
+// state's buffer is already taken, the new buffer is left on the stack to keep it alive.
+inline PNGBuffer *TakePNGBuffer(lua_State *State)
+{
+	lua_pushlightuserdata(State, (UID)PNGBufferKey);
+	lua_rawget(State, LUA_REGISTRYINDEX);
+	PNGBuffer *Buffer = static_cast<PNGBuffer *>(lua_touserdata(State, -1));
+	lua_pop(State, 1);
+	if (Buffer == nullptr)
+	{
+		lua_pushlightuserdata(State, (UID)PNGBufferKey);
+		Buffer = PushPNGBuffer(State);
+		lua_rawset(State, LUA_REGISTRYINDEX);
+	}
+	else if (Buffer->Taken) Buffer = PushPNGBuffer(State);
+	Buffer->Size = 0;
+	Buffer->Taken = true;
+	return Buffer;
+}
+
+inline void ReturnPNGBuffer(PNGBuffer *Buffer) { Buffer->Taken = false; }
+
+inline bool AppendToPNGBuffer(PNGBuffer *Buffer, unsigned char const *Data, size_t Length)
+{
+	if (Buffer->Size + Length > Buffer->Capacity)
+	{
+		size_t Capacity = Buffer->Capacity == 0 ? 65536 : Buffer->Capacity;
+		while (Capacity < Buffer->Size + Length) Capacity *= 2;
+		unsigned char *Grown = static_cast<unsigned char *>(realloc(Buffer->Data, Capacity));
+		if (Grown == nullptr) return false;
+		Buffer->Data = Grown;
+		Buffer->Capacity = Capacity;
+	}
+	memcpy(Buffer->Data + Buffer->Size, Data, Length);
+	Buffer->Size += Length;
+	return true;
+}
+
+static cairo_status_t WritePNGToBuffer(void *Closure, unsigned char const *Data, unsigned int Length)
+{
+	return AppendToPNGBuffer(static_cast<PNGBuffer *>(Closure), Data, Length) ? CAIRO_STATUS_SUCCESS : CAIRO_STATUS_NO_MEMORY;
+}
+
+static int WriteSurfaceToPNGString(lua_State *State)
+{
+	cairo_surface_t *Surface = LuaValue<cairo_surface_t *>::Read(State, 1);
+	PNGBuffer *Buffer = TakePNGBuffer(State);
+	cairo_status_t Status = cairo_surface_write_to_png_stream(Surface, WritePNGToBuffer, Buffer);
+	ReturnPNGBuffer(Buffer);
+	if (Status != CAIRO_STATUS_SUCCESS)
+		return luaL_error(State, "Failed to encode PNG: %s", cairo_status_to_string(Status));
+	lua_pushlstring(State, reinterpret_cast<char const *>(Buffer->Data), Buffer->Size);
+	return 1;
+}
+
+// Lua errors can't unwind through cairo, so callbacks are run protected and any error is left on the stack and
+// rethrown once cairo returns.
+struct PNGStreamWriter
+{
+	lua_State *State;
+	int Function;
+	PNGBuffer *Buffer;
+	size_t ChunkSize;
+	bool Failed;
+};
+
+inline bool FlushPNGStream(PNGStreamWriter *Writer)
+{
+	if (Writer->Buffer->Size == 0) return true;
+	lua_pushvalue(Writer->State, Writer->Function);
+	lua_pushlstring(Writer->State, reinterpret_cast<char const *>(Writer->Buffer->Data), Writer->Buffer->Size);
+	Writer->Buffer->Size = 0;
+	if (lua_pcall(Writer->State, 1, 0, 0) != LUA_OK)
+	{
+		Writer->Failed = true;
+		return false;
+	}
+	return true;
+}
+
+static cairo_status_t WritePNGToStream(void *Closure, unsigned char const *Data, unsigned int Length)
+{
+	PNGStreamWriter *Writer = static_cast<PNGStreamWriter *>(Closure);
+	if (!AppendToPNGBuffer(Writer->Buffer, Data, Length)) return CAIRO_STATUS_NO_MEMORY;
+	if ((Writer->Buffer->Size >= Writer->ChunkSize) && !FlushPNGStream(Writer)) return CAIRO_STATUS_WRITE_ERROR;
+	return CAIRO_STATUS_SUCCESS;
+}
+
+static int WriteSurfaceToPNGStream(lua_State *State)
+{
+	// surface:writetopngstream(function(chunk) ... end[, chunksize])
+	PNGStreamWriter Writer;
+	Writer.State = State;
+	Writer.Function = 2;
+	Writer.ChunkSize = luaL_optinteger(State, 3, 65536);
+	Writer.Failed = false;
+	cairo_surface_t *Surface = LuaValue<cairo_surface_t *>::Read(State, 1);
+	luaL_checktype(State, 2, LUA_TFUNCTION);
+	lua_settop(State, 2);
+	Writer.Buffer = TakePNGBuffer(State);
+
+	// The callback may release the surface, so keep it alive until cairo is done with it
+	cairo_surface_reference(Surface);
+	cairo_status_t Status = cairo_surface_write_to_png_stream(Surface, WritePNGToStream, &Writer);
+	cairo_surface_destroy(Surface);
+	if ((Status == CAIRO_STATUS_SUCCESS) && !FlushPNGStream(&Writer)) Status = CAIRO_STATUS_WRITE_ERROR;
+	ReturnPNGBuffer(Writer.Buffer);
+	if (Writer.Failed) return lua_error(State);
+	if (Status != CAIRO_STATUS_SUCCESS)
+		return luaL_error(State, "Failed to encode PNG: %s", cairo_status_to_string(Status));
+	return 0;
+}
+
+struct PNGStringReader
+{
+	unsigned char const *Data;
+	size_t Remaining;
+};
+
+static cairo_status_t ReadPNGFromString(void *Closure, unsigned char *Data, unsigned int Length)
+{
+	PNGStringReader *Reader = static_cast<PNGStringReader *>(Closure);
+	if (Length > Reader->Remaining) return CAIRO_STATUS_READ_ERROR;
+	memcpy(Data, Reader->Data, Length);
+	Reader->Data += Length;
+	Reader->Remaining -= Length;
+	return CAIRO_STATUS_SUCCESS;
+}
+
+static int CreateImageSurfaceFromPNGString(lua_State *State)
+{
+	PNGStringReader Reader;
+	Reader.Data = reinterpret_cast<unsigned char const *>(luaL_checklstring(State, 1, &Reader.Remaining));
+	cairo_surface_t *Surface = cairo_image_surface_create_from_png_stream(ReadPNGFromString, &Reader);
+	LuaValue<cairo_surface_t *>::Write(State, lua_upvalueindex(1), Surface);
+	return 1;
+}
+
+struct PNGStreamReader
+{
+	lua_State *State;
+	int Function;
+	char const *Chunk;
+	size_t ChunkSize;
+	size_t Offset;
+	bool Failed;
+};
+
+static cairo_status_t ReadPNGFromStream(void *Closure, unsigned char *Data, unsigned int Length)
+{
+	// The current chunk stays on top of the stack until it's used up
+	PNGStreamReader *Reader = static_cast<PNGStreamReader *>(Closure);
+	while (Length > 0)
+	{
+		if (Reader->Offset == Reader->ChunkSize)
+		{
+			if (Reader->Chunk != nullptr) lua_pop(Reader->State, 1);
+			Reader->Chunk = nullptr;
+			lua_pushvalue(Reader->State, Reader->Function);
+			lua_pushinteger(Reader->State, Length);
+			if (lua_pcall(Reader->State, 1, 1, 0) != LUA_OK)
+			{
+				Reader->Failed = true;
+				return CAIRO_STATUS_READ_ERROR;
+			}
+			if (lua_type(Reader->State, -1) != LUA_TSTRING)
+			{
+				lua_pop(Reader->State, 1);
+				return CAIRO_STATUS_READ_ERROR;
+			}
+			Reader->Chunk = lua_tolstring(Reader->State, -1, &Reader->ChunkSize);
+			Reader->Offset = 0;
+			if (Reader->ChunkSize == 0)
+			{
+				lua_pop(Reader->State, 1);
+				Reader->Chunk = nullptr;
+				return CAIRO_STATUS_READ_ERROR;
+			}
+		}
+		size_t Copied = std::min<size_t>(Length, Reader->ChunkSize - Reader->Offset);
+		memcpy(Data, Reader->Chunk + Reader->Offset, Copied);
+		Reader->Offset += Copied;
+		Data += Copied;
+		Length -= Copied;
+	}
+	return CAIRO_STATUS_SUCCESS;
+}
+
+static int CreateImageSurfaceFromPNGStream(lua_State *State)
+{
+	// cairo.imagesurfacefrompngstream(function(size) return chunk end), where the function returns nil at the end
+	luaL_checktype(State, 1, LUA_TFUNCTION);
+	lua_settop(State, 1);
+	PNGStreamReader Reader;
+	Reader.State = State;
+	Reader.Function = 1;
+	Reader.Chunk = nullptr;
+	Reader.ChunkSize = 0;
+	Reader.Offset = 0;
+	Reader.Failed = false;
+	cairo_surface_t *Surface = cairo_image_surface_create_from_png_stream(ReadPNGFromStream, &Reader);
+	if (Reader.Failed)
+	{
+		cairo_surface_destroy(Surface);
+		return lua_error(State);
+	}
+	lua_settop(State, 1);
+	LuaValue<cairo_surface_t *>::Write(State, lua_upvalueindex(1), Surface);
+	return 1;
+}
+#endif
+
+#endif
@@ -2,55 +2,166 @@
 #define registration_h
 
 #include "library.h"
+#include "buffer.h"
+#include "path.h"
+#include "imagedata.h"
+#include "png.h"
+#include "tiled.h"
+#include "layercache.h"
+#include "surfacepool.h"
+#include "shapecache.h"
+#include "instances.h"
+#include "text.h"
 
 // Matrix stuff
-static int DestroyMatrix(lua_State *State)
-{
-	cairo_matrix_t *Matrix = LuaValue<cairo_matrix_t *>::Read(State, 1);
-	delete Matrix;
-	lua_settop(State, 0);
-	return 0;
-}
+// Matrices are values stored inline in their Lua objects.
+template <> struct LuaValue<cairo_matrix_t> : InlineValue<cairo_matrix_t> {};
+template <> struct IsObject<cairo_matrix_t> { static constexpr bool Value = true; };
 
-cairo_matrix_t *CreateMatrix(double xx, double yx, double xy, double yy, double x0, double y0)
+cairo_matrix_t CreateMatrix(double xx, double yx, double xy, double yy, double x0, double y0)
 { 
-	cairo_matrix_t *Out = new cairo_matrix_t;
-	cairo_matrix_init(Out, xx, yx, xy, yy, x0, y0);
+	cairo_matrix_t Out;
+	cairo_matrix_init(&Out, xx, yx, xy, yy, x0, y0);
 	return Out;
 }
 
-cairo_matrix_t *CreateIdentityMatrix(void)
+cairo_matrix_t CreateIdentityMatrix(void)
 { 
-	cairo_matrix_t *Out = new cairo_matrix_t;
-	cairo_matrix_init_identity(Out);
+	cairo_matrix_t Out;
+	cairo_matrix_init_identity(&Out);
 	return Out;
 }
 
-cairo_matrix_t *CreateTranslateMatrix(double tx, double ty)
+cairo_matrix_t CreateTranslateMatrix(double tx, double ty)
 { 
-	cairo_matrix_t *Out = new cairo_matrix_t;
-	cairo_matrix_init_translate(Out, tx, ty);
+	cairo_matrix_t Out;
+	cairo_matrix_init_translate(&Out, tx, ty);
 	return Out;
 }
 
-cairo_matrix_t *CreateScaleMatrix(double sx, double sy)
+cairo_matrix_t CreateScaleMatrix(double sx, double sy)
 { 
-	cairo_matrix_t *Out = new cairo_matrix_t;
-	cairo_matrix_init_scale(Out, sx, sy);
+	cairo_matrix_t Out;
+	cairo_matrix_init_scale(&Out, sx, sy);
 	return Out;
 }
 
-cairo_matrix_t *CreateRotateMatrix(double radians)
+cairo_matrix_t CreateRotateMatrix(double radians)
 { 
-	cairo_matrix_t *Out = new cairo_matrix_t;
-	cairo_matrix_init_rotate(Out, radians);
+	cairo_matrix_t Out;
+	cairo_matrix_init_rotate(&Out, radians);
+	return Out;
+}
+
+// a * b applies a, then b
+cairo_matrix_t MultiplyMatrices(cairo_matrix_t const *First, cairo_matrix_t const *Second)
+{
+	cairo_matrix_t Out;
+	cairo_matrix_multiply(&Out, First, Second);
 	return Out;
 }
 
+cairo_matrix_t CopyMatrix(cairo_matrix_t const *Matrix)
+	{ return *Matrix; }
+
+// Batch transforms over flat x, y arrays.  In and Out may be the same array.
+template <bool Distance> void TransformCoordinates(cairo_matrix_t const &Matrix, double const *In, double *Out, size_t Count)
+{
+	double const XX = Matrix.xx, YX = Matrix.yx, XY = Matrix.xy, YY = Matrix.yy;
+	double const X0 = Distance ? 0.0 : Matrix.x0, Y0 = Distance ? 0.0 : Matrix.y0;
+	for (size_t Index = 0; Index + 1 < Count; Index += 2)
+	{
+		double const X = In[Index], Y = In[Index + 1];
+		Out[Index] = XX * X + XY * Y + X0;
+		Out[Index + 1] = YX * X + YY * Y + Y0;
+	}
+}
+
+// Returns the transformed coordinates in the same form they were given (table, packed string or buffer)
+template <bool Distance> int TransformMatrixCoordinates(lua_State *State)
+{
+	cairo_matrix_t const *Matrix = LuaValue<cairo_matrix_t *>::Read(State, 1);
+	int const Kind = lua_type(State, 2);
+	PackedArray<double> Points(State, 2);
+	if (Points.Count % 2 != 0)
+		return luaL_error(State, "Parameter 2 must contain x, y pairs, but it has %d values.", (int)Points.Count);
+
+	if (Kind == LUA_TSTRING)
+	{
+		luaL_Buffer Out;
+		double *Coordinates = reinterpret_cast<double *>(luaL_buffinitsize(State, &Out, Points.Count * sizeof(double)));
+		TransformCoordinates<Distance>(*Matrix, Points.Data, Coordinates, Points.Count);
+		luaL_pushresultsize(&Out, Points.Count * sizeof(double));
+		return 1;
+	}
+
+	DoubleBuffer *Out = PushDoubleBuffer(State, lua_upvalueindex(1), Points.Count);
+	TransformCoordinates<Distance>(*Matrix, Points.Data, Out->Data, Points.Count);
+	if (Kind == LUA_TTABLE)
+	{
+		lua_createtable(State, Out->Count, 0);
+		for (size_t Index = 0; Index < Out->Count; ++Index)
+		{
+			lua_pushnumber(State, Out->Data[Index]);
+			lua_rawseti(State, -2, Index + 1);
+		}
+	}
+	return 1;
+}
+
+template <bool Distance> int TransformMatrixCoordinatesInPlace(lua_State *State)
+{
+	cairo_matrix_t const *Matrix = LuaValue<cairo_matrix_t *>::Read(State, 1);
+	DoubleBuffer *Points = LuaValue<DoubleBuffer *>::Read(State, 2);
+	if (Points->Count % 2 != 0)
+		return luaL_error(State, "Parameter 2 must contain x, y pairs, but it has %d values.", (int)Points->Count);
+	TransformCoordinates<Distance>(*Matrix, Points->Data, Points->Data, Points->Count);
+	return 0;
+}
+
+static int CompareMatrices(lua_State *State)
+{
+	cairo_matrix_t const *First = LuaValue<cairo_matrix_t *>::Read(State, 1);
+	cairo_matrix_t const *Second = LuaValue<cairo_matrix_t *>::Read(State, 2);
+	lua_pushboolean(State, 
+		(First->xx == Second->xx) && (First->yx == Second->yx) && 
+		(First->xy == Second->xy) && (First->yy == Second->yy) && 
+		(First->x0 == Second->x0) && (First->y0 == Second->y0));
+	return 1;
+}
+
+static int MatrixToString(lua_State *State)
+{
+	cairo_matrix_t const *Matrix = LuaValue<cairo_matrix_t *>::Read(State, 1);
+	lua_pushfstring(State, "matrix(%f, %f, %f, %f, %f, %f)", Matrix->xx, Matrix->yx, Matrix->xy, Matrix->yy, Matrix->x0, Matrix->y0);
+	return 1;
+}
+
+#ifdef CAIRO_HAS_RECORDING_SURFACE
+// Recording surfaces are unbounded unless x, y, width and height are given
+static int CreateRecordingSurface(lua_State *State)
+{
+	cairo_content_t Content = LuaValue<cairo_content_t>::Read(State, 1);
+	cairo_surface_t *Surface;
+	if (lua_isnoneornil(State, 2)) Surface = cairo_recording_surface_create(Content, nullptr);
+	else
+	{
+		cairo_rectangle_t Extents;
+		Extents.x = luaL_checknumber(State, 2);
+		Extents.y = luaL_checknumber(State, 3);
+		Extents.width = luaL_checknumber(State, 4);
+		Extents.height = luaL_checknumber(State, 5);
+		Surface = cairo_recording_surface_create(Content, &Extents);
+	}
+	LuaValue<cairo_surface_t *>::Write(State, lua_upvalueindex(1), Surface);
+	return 1;
+}
+#endif
+
 // Bulk registration
 inline void RegisterSurfaceMethods(lua_State *State)
 {
-	// Perhaps some sort of metatable inheritance should be implemented, but for now I just duplicate the cfunctions in lua for "inheritance".
+	// Methods shared by all surfaces; the specific surface metatables are created with this one as their parent.
 	Register(State, "status", cairo_surface_status);
 	Register(State, "finish", cairo_surface_finish);
 	Register(State, "flush", cairo_surface_flush);
@@ -64,6 +175,7 @@ inline void RegisterSurfaceMethods(lua_State *State)
 	Register(State, "setfallbackresolution", cairo_surface_set_fallback_resolution);
 	RegisterMultipleReturn(State, "getfallbackresolution", cairo_surface_get_fallback_resolution);
 	Register(State, "gettype", cairo_surface_get_type);
+	RegisterLuaFunction(State, "release", ReleaseSurface);
 	//Register(State, "getreferencecount", cairo_surface_get_reference_count); // Useful?
 	//Register(State, "setuserdata", cairo_surface_set_user_data); // Not useful?
 	//Register(State, "getuserdata", cairo_surface_get_user_data); // Not useful?
@@ -78,167 +190,426 @@ inline void RegisterSurfaceMethods(lua_State *State)
 
 #ifdef CAIRO_HAS_PNG_FUNCTIONS
 	Register(State, "writetopng", cairo_surface_write_to_png);
+	RegisterLuaFunction(State, "topngstring", WriteSurfaceToPNGString);
+	RegisterLuaFunction(State, "writetopngstream", WriteSurfaceToPNGStream);
 #endif
 }
 
-inline void RegisterEverything(lua_State *State)
+//-- Enums
+constexpr EnumValue AntialiasValues[] = 
 {
-#ifndef NDEBUG
-	unsigned int const InitialHeight = lua_gettop(State);
+	{"DEFAULT", CAIRO_ANTIALIAS_DEFAULT},
+	{"NONE", CAIRO_ANTIALIAS_NONE},
+	{"GRAY", CAIRO_ANTIALIAS_GRAY},
+	{"SUBPIXEL", CAIRO_ANTIALIAS_SUBPIXEL}
+};
+
+constexpr EnumValue FillRuleValues[] = 
+{
+	{"WINDING", CAIRO_FILL_RULE_WINDING},
+	{"EVENODD", CAIRO_FILL_RULE_EVEN_ODD}
+};
+
+constexpr EnumValue LineCapValues[] = 
+{
+	{"BUTT", CAIRO_LINE_CAP_BUTT},
+	{"ROUND", CAIRO_LINE_CAP_ROUND},
+	{"SQUARE", CAIRO_LINE_CAP_SQUARE}
+};
+
+constexpr EnumValue LineJoinValues[] = 
+{
+	{"MITER", CAIRO_LINE_JOIN_MITER},
+	{"ROUND", CAIRO_LINE_JOIN_ROUND},
+	{"BEVEL", CAIRO_LINE_JOIN_BEVEL}
+};
+
+constexpr EnumValue OperatorValues[] = 
+{
+	{"CLEAR", CAIRO_OPERATOR_CLEAR},
+	{"SOURCE", CAIRO_OPERATOR_SOURCE},
+	{"OVER", CAIRO_OPERATOR_OVER},
+	{"IN", CAIRO_OPERATOR_IN},
+	{"OUT", CAIRO_OPERATOR_OUT},
+	{"ATOP", CAIRO_OPERATOR_ATOP},
+	{"DEST", CAIRO_OPERATOR_DEST},
+	{"DESTOVER", CAIRO_OPERATOR_DEST_OVER},
+	{"DESTIN", CAIRO_OPERATOR_DEST_IN},
+	{"DESTOUT", CAIRO_OPERATOR_DEST_OUT},
+	{"DESTATOP", CAIRO_OPERATOR_DEST_ATOP},
+	{"XOR", CAIRO_OPERATOR_XOR},
+	{"ADD", CAIRO_OPERATOR_ADD},
+	{"SATURATE", CAIRO_OPERATOR_SATURATE},
+	{"MULTIPLY", CAIRO_OPERATOR_MULTIPLY},
+	{"SCREEN", CAIRO_OPERATOR_SCREEN},
+	{"OVERLAY", CAIRO_OPERATOR_OVERLAY},
+	{"DARKEN", CAIRO_OPERATOR_DARKEN},
+	{"LIGHTEN", CAIRO_OPERATOR_LIGHTEN},
+	{"COLORDODGE", CAIRO_OPERATOR_COLOR_DODGE},
+	{"COLORBURN", CAIRO_OPERATOR_COLOR_BURN},
+	{"HARDLIGHT", CAIRO_OPERATOR_HARD_LIGHT},
+	{"SOFTLIGHT", CAIRO_OPERATOR_SOFT_LIGHT},
+	{"DIFFERENCE", CAIRO_OPERATOR_DIFFERENCE},
+	{"EXCLUSION", CAIRO_OPERATOR_EXCLUSION},
+	{"HSLHUE", CAIRO_OPERATOR_HSL_HUE},
+	{"HSLSATURATION", CAIRO_OPERATOR_HSL_SATURATION},
+	{"HSLCOLOR", CAIRO_OPERATOR_HSL_COLOR},
+	{"HSLLUMINOSITY", CAIRO_OPERATOR_HSL_LUMINOSITY}
+};
+
+constexpr EnumValue PathDataValues[] = 
+{
+	{"MOVETO", CAIRO_PATH_MOVE_TO},
+	{"LINETO", CAIRO_PATH_LINE_TO},
+	{"CURVETO", CAIRO_PATH_CURVE_TO},
+	{"CLOSEPATH", CAIRO_PATH_CLOSE_PATH}
+};
+
+constexpr EnumValue ExtendValues[] = 
+{
+	{"NONE", CAIRO_EXTEND_NONE},
+	{"REPEAT", CAIRO_EXTEND_REPEAT},
+	{"REFLECT", CAIRO_EXTEND_REFLECT},
+	{"PAD", CAIRO_EXTEND_PAD}
+};
+
+constexpr EnumValue FilterValues[] = 
+{
+	{"FAST", CAIRO_FILTER_FAST},
+	{"GOOD", CAIRO_FILTER_GOOD},
+	{"BEST", CAIRO_FILTER_BEST},
+	{"NEAREST", CAIRO_FILTER_NEAREST},
+	{"BILINEAR", CAIRO_FILTER_BILINEAR},
+	{"GAUSSIAN", CAIRO_FILTER_GAUSSIAN}
+};
+
+constexpr EnumValue PatternTypeValues[] = 
+{
+	{"SOLID", CAIRO_PATTERN_TYPE_SOLID},
+	{"SURFACE", CAIRO_PATTERN_TYPE_SURFACE},
+	{"LINEAR", CAIRO_PATTERN_TYPE_LINEAR},
+	{"RADIAL", CAIRO_PATTERN_TYPE_RADIAL}
+};
+
+constexpr EnumValue RegionOverlapValues[] = 
+{
+	{"IN", CAIRO_REGION_OVERLAP_IN},
+	{"OUT", CAIRO_REGION_OVERLAP_OUT},
+	{"PART", CAIRO_REGION_OVERLAP_PART}
+};
+
+constexpr EnumValue DeviceTypeValues[] = 
+{
+	{"DRM", CAIRO_DEVICE_TYPE_DRM},
+	{"GL", CAIRO_DEVICE_TYPE_GL},
+	{"SCRIPT", CAIRO_DEVICE_TYPE_SCRIPT},
+	{"XCB", CAIRO_DEVICE_TYPE_XCB},
+	{"XLIB", CAIRO_DEVICE_TYPE_XLIB},
+	{"XML", CAIRO_DEVICE_TYPE_XML}
+};
+
+constexpr EnumValue ContentValues[] = 
+{
+	{"COLOR", CAIRO_CONTENT_COLOR},
+	{"ALPHA", CAIRO_CONTENT_ALPHA},
+	{"COLORALPHA", CAIRO_CONTENT_COLOR_ALPHA}
+};
+
+constexpr EnumValue SurfaceTypeValues[] = 
+{
+	{"IMAGE", CAIRO_SURFACE_TYPE_IMAGE},
+	{"PDF", CAIRO_SURFACE_TYPE_PDF},
+	{"PS", CAIRO_SURFACE_TYPE_PS},
+	{"XLIB", CAIRO_SURFACE_TYPE_XLIB},
+	{"XCB", CAIRO_SURFACE_TYPE_XCB},
+	{"GLITZ", CAIRO_SURFACE_TYPE_GLITZ},
+	{"QUARTZ", CAIRO_SURFACE_TYPE_QUARTZ},
+	{"WIN32", CAIRO_SURFACE_TYPE_WIN32},
+	{"BEOS", CAIRO_SURFACE_TYPE_BEOS},
+	{"DIRECTFB", CAIRO_SURFACE_TYPE_DIRECTFB},
+	{"SVG", CAIRO_SURFACE_TYPE_SVG},
+	{"OS2", CAIRO_SURFACE_TYPE_OS2},
+	{"WIN32PRINTING", CAIRO_SURFACE_TYPE_WIN32_PRINTING},
+	{"QUARTZIMAGE", CAIRO_SURFACE_TYPE_QUARTZ_IMAGE},
+	{"SCRIPT", CAIRO_SURFACE_TYPE_SCRIPT},
+	{"QT", CAIRO_SURFACE_TYPE_QT},
+	{"RECORDING", CAIRO_SURFACE_TYPE_RECORDING},
+	{"VG", CAIRO_SURFACE_TYPE_VG},
+	{"GL", CAIRO_SURFACE_TYPE_GL},
+	{"DRM", CAIRO_SURFACE_TYPE_DRM},
+	{"TEE", CAIRO_SURFACE_TYPE_TEE},
+	{"XML", CAIRO_SURFACE_TYPE_XML},
+	{"SKIA", CAIRO_SURFACE_TYPE_SKIA},
+	{"SUBSURFACE", CAIRO_SURFACE_TYPE_SUBSURFACE}
+};
+
+constexpr EnumValue FormatValues[] = 
+{
+	{"INVALID", CAIRO_FORMAT_INVALID},
+	{"ARGB32", CAIRO_FORMAT_ARGB32},
+	{"RGB24", CAIRO_FORMAT_RGB24},
+	{"A8", CAIRO_FORMAT_A8},
+	{"A1", CAIRO_FORMAT_A1},
+	{"RGB16565", CAIRO_FORMAT_RGB16_565}
+};
+
+constexpr EnumValue FontSlantValues[] = 
+{
+	{"NORMAL", CAIRO_FONT_SLANT_NORMAL},
+	{"ITALIC", CAIRO_FONT_SLANT_ITALIC},
+	{"OBLIQUE", CAIRO_FONT_SLANT_OBLIQUE}
+};
+
+constexpr EnumValue FontWeightValues[] = 
+{
+	{"NORMAL", CAIRO_FONT_WEIGHT_NORMAL},
+	{"BOLD", CAIRO_FONT_WEIGHT_BOLD}
+};
+
+constexpr EnumValue FontTypeValues[] = 
+{
+	{"TOY", CAIRO_FONT_TYPE_TOY},
+	{"FT", CAIRO_FONT_TYPE_FT},
+	{"WIN32", CAIRO_FONT_TYPE_WIN32},
+	{"QUARTZ", CAIRO_FONT_TYPE_QUARTZ},
+	{"USER", CAIRO_FONT_TYPE_USER}
+};
+
+#ifdef CAIRO_HAS_SVG_SURFACE
+constexpr EnumValue SVGVersionValues[] = 
+{
+	{"11", CAIRO_SVG_VERSION_1_1},
+	{"12", CAIRO_SVG_VERSION_1_2}
+};
 #endif
-	lua_newtable(State);
 
-	RegisterEnum(State, "antialias", {
-		{"DEFAULT", CAIRO_ANTIALIAS_DEFAULT},
-		{"NONE", CAIRO_ANTIALIAS_NONE},
-		{"GRAY", CAIRO_ANTIALIAS_GRAY},
-		{"SUBPIXEL", CAIRO_ANTIALIAS_SUBPIXEL},
-	});
+static UIDObject PatternMetatable;
+static UIDObject SurfaceMetatable;
+static UIDObject PathMetatable;
+static UIDObject FontFaceMetatable;
+static UIDObject ScaledFontMetatable;
 
-	RegisterEnum(State, "fillrule", {
-		{"WINDING", CAIRO_FILL_RULE_WINDING},
-		{"EVENODD", CAIRO_FILL_RULE_EVEN_ODD},
-	});
+// Groups of fields created the first time one of them is used; called with the cairo table on top of the stack.
+inline void LoadPatterns(lua_State *State)
+{
+	RegisterWithMetatable(State, "rgbpattern", cairo_pattern_create_rgb, (UID)PatternMetatable);
+	RegisterWithMetatable(State, "rgbapattern", cairo_pattern_create_rgba, (UID)PatternMetatable);
+	RegisterWithMetatable(State, "linearpattern", cairo_pattern_create_linear, (UID)PatternMetatable);
+	RegisterWithMetatable(State, "radialpattern", cairo_pattern_create_radial, (UID)PatternMetatable);
+	RegisterWithMetatable(State, "surfacepattern", cairo_pattern_create_for_surface, (UID)PatternMetatable);
+	//RegisterWithMetatable(State, "createmesh", cairo_pattern_create_mesh, (UID)PatternMetatable); // 1.12 
+}
 
-	RegisterEnum(State, "linecap", {
-		{"BUTT", CAIRO_LINE_CAP_BUTT},
-		{"ROUND", CAIRO_LINE_CAP_ROUND},
-		{"SQUARE", CAIRO_LINE_CAP_SQUARE},
+inline void LoadRegions(lua_State *State)
+{
+	CreateLazyMetatable(State, AsUID(cairo_region_create), [](lua_State *State)
+	{
+		RegisterWithMetatable(State, "copy", cairo_region_copy, AsUID(cairo_region_create));
+		Register(State, "status", cairo_region_status);
+		Register(State, "getextents", cairo_region_get_extents);
+		Register(State, "numrectangles", cairo_region_num_rectangles);
+		Register(State, "getrectangle", cairo_region_get_rectangle);
+		Register(State, "isempty", cairo_region_is_empty);
+		Register(State, "containspoint", cairo_region_contains_point);
+		Register(State, "containsrectangle", cairo_region_contains_rectangle);
+		Register(State, "equal", cairo_region_equal);
+		Register(State, "translate", cairo_region_translate);
+		Register(State, "intersect", cairo_region_intersect);
+		Register(State, "intersectrectangle", cairo_region_intersect_rectangle);
+		Register(State, "subtract", cairo_region_subtract);
+		Register(State, "subtractrectangle", cairo_region_subtract_rectangle);
+		Register(State, "union", cairo_region_union);
+		Register(State, "unionrectangle", cairo_region_union_rectangle);
+		Register(State, "xor", cairo_region_xor);
+		Register(State, "xorrectangle", cairo_region_xor_rectangle);
 	});
+	SetMetatableGarbageCollector(State, AsUID(cairo_region_create), cairo_region_destroy);
+	Register(State, "region", cairo_region_create);
+	RegisterWithMetatable(State, "rectanglecairoregion", cairo_region_create_rectangle, AsUID(cairo_region_create));
+	RegisterWithMetatable(State, "cairoregionfromrectangles", cairo_region_create_rectangles, AsUID(cairo_region_create));
+}
 
-	RegisterEnum(State, "linejoin", {
-		{"MITER", CAIRO_LINE_JOIN_MITER},
-		{"ROUND", CAIRO_LINE_JOIN_ROUND},
-		{"BEVEL", CAIRO_LINE_JOIN_BEVEL},
+inline void LoadMatrices(lua_State *State)
+{
+	CreateLazyMetatable(State, AsUID(CreateMatrix), [](lua_State *State)
+	{
+		Register(State, "init", cairo_matrix_init);
+		Register(State, "initidentity", cairo_matrix_init_identity);
+		Register(State, "inittranslate", cairo_matrix_init_translate);
+		Register(State, "initscale", cairo_matrix_init_scale);
+		Register(State, "initrotate", cairo_matrix_init_rotate);
+		Register(State, "translate", cairo_matrix_translate);
+		Register(State, "scale", cairo_matrix_scale);
+		Register(State, "rotate", cairo_matrix_rotate);
+		Register(State, "invert", cairo_matrix_invert);
+		Register(State, "multiply", cairo_matrix_multiply);
+		RegisterInputOutput(State, "transformdistance", cairo_matrix_transform_distance);
+		RegisterInputOutput(State, "transformpoint", cairo_matrix_transform_point);
+		RegisterWithMetatable(State, "copy", CopyMatrix, AsUID(CreateMatrix));
+		RegisterLuaFunctionWithMetatable(State, "transformpoints", TransformMatrixCoordinates<false>, AsUID(CreateDoubleBuffer));
+		RegisterLuaFunctionWithMetatable(State, "transformdistances", TransformMatrixCoordinates<true>, AsUID(CreateDoubleBuffer));
+		RegisterLuaFunction(State, "transformpointsinplace", TransformMatrixCoordinatesInPlace<false>);
+		RegisterLuaFunction(State, "transformdistancesinplace", TransformMatrixCoordinatesInPlace<true>);
 	});
-
-	RegisterEnum(State, "operator", {
-		{"CLEAR", CAIRO_OPERATOR_CLEAR},
-		{"SOURCE", CAIRO_OPERATOR_SOURCE},
-		{"OVER", CAIRO_OPERATOR_OVER},
-		{"IN", CAIRO_OPERATOR_IN},
-		{"OUT", CAIRO_OPERATOR_OUT},
-		{"ATOP", CAIRO_OPERATOR_ATOP},
-		{"DEST", CAIRO_OPERATOR_DEST},
-		{"DESTOVER", CAIRO_OPERATOR_DEST_OVER},
-		{"DESTIN", CAIRO_OPERATOR_DEST_IN},
-		{"DESTOUT", CAIRO_OPERATOR_DEST_OUT},
-		{"DESTATOP", CAIRO_OPERATOR_DEST_ATOP},
-		{"XOR", CAIRO_OPERATOR_XOR},
-		{"ADD", CAIRO_OPERATOR_ADD},
-		{"SATURATE", CAIRO_OPERATOR_SATURATE},
-		{"MULTIPLY", CAIRO_OPERATOR_MULTIPLY},
-		{"SCREEN", CAIRO_OPERATOR_SCREEN},
-		{"OVERLAY", CAIRO_OPERATOR_OVERLAY},
-		{"DARKEN", CAIRO_OPERATOR_DARKEN},
-		{"LIGHTEN", CAIRO_OPERATOR_LIGHTEN},
-		{"COLORDODGE", CAIRO_OPERATOR_COLOR_DODGE},
-		{"COLORBURN", CAIRO_OPERATOR_COLOR_BURN},
-		{"HARDLIGHT", CAIRO_OPERATOR_HARD_LIGHT},
-		{"SOFTLIGHT", CAIRO_OPERATOR_SOFT_LIGHT},
-		{"DIFFERENCE", CAIRO_OPERATOR_DIFFERENCE},
-		{"EXCLUSION", CAIRO_OPERATOR_EXCLUSION},
-		{"HSLHUE", CAIRO_OPERATOR_HSL_HUE},
-		{"HSLSATURATION", CAIRO_OPERATOR_HSL_SATURATION},
-		{"HSLCOLOR", CAIRO_OPERATOR_HSL_COLOR},
-		{"HSLLUMINOSITY", CAIRO_OPERATOR_HSL_LUMINOSITY},
+	ExtendMetatable(State, AsUID(CreateMatrix), [&](void)
+	{
+		RegisterWithMetatable(State, "__mul", MultiplyMatrices, AsUID(CreateMatrix));
+		RegisterLuaFunction(State, "__eq", CompareMatrices);
+		RegisterLuaFunction(State, "__tostring", MatrixToString);
 	});
+	Register(State, "matrix", CreateMatrix);
+	RegisterWithMetatable(State, "identitymatrix", CreateIdentityMatrix, AsUID(CreateMatrix));
+	RegisterWithMetatable(State, "translatematrix", CreateTranslateMatrix, AsUID(CreateMatrix));
+	RegisterWithMetatable(State, "scalematrix", CreateScaleMatrix, AsUID(CreateMatrix));
+	RegisterWithMetatable(State, "rotatematrix", CreateRotateMatrix, AsUID(CreateMatrix));
+}
 
-	RegisterEnum(State, "path", {
-		{"MOVETO", CAIRO_PATH_MOVE_TO},
-		{"LINETO", CAIRO_PATH_LINE_TO},
-		{"CURVETO", CAIRO_PATH_CURVE_TO},
-		{"CLOSEPATH", CAIRO_PATH_CLOSE_PATH},
-	});
+inline void LoadFonts(lua_State *State)
+{
+	RegisterWithMetatable(State, "toyfontface", cairo_toy_font_face_create, (UID)FontFaceMetatable);
+	RegisterLuaFunctionWithMetatable(State, "scaledfont", CreateScaledFont, (UID)ScaledFontMetatable);
+}
 
-	RegisterEnum(State, "extend", {
-		{"NONE", CAIRO_EXTEND_NONE},
-		{"REPEAT", CAIRO_EXTEND_REPEAT},
-		{"REFLECT", CAIRO_EXTEND_REFLECT},
-		{"PAD", CAIRO_EXTEND_PAD},
-	});
+inline void LoadLayerCache(lua_State *State)
+{
+	RegisterLuaFunction(State, "setlayercachebudget", SetLayerCacheBudget);
+	RegisterLuaFunction(State, "getlayercachesize", GetLayerCacheSize);
+	RegisterLuaFunction(State, "clearlayercache", ClearLayerCache);
+}
 
-	RegisterEnum(State, "filter", {
-		{"FAST", CAIRO_FILTER_FAST},
-		{"GOOD", CAIRO_FILTER_GOOD},
-		{"BEST", CAIRO_FILTER_BEST},
-		{"NEAREST", CAIRO_FILTER_NEAREST},
-		{"BILINEAR", CAIRO_FILTER_BILINEAR},
-		{"GAUSSIAN", CAIRO_FILTER_GAUSSIAN},
-	});
+inline void LoadShapeCache(lua_State *State)
+{
+	RegisterLuaFunction(State, "defineshape", DefineShape);
+	RegisterLuaFunction(State, "setshapecachebudget", SetShapeCacheBudget);
+	RegisterLuaFunction(State, "getshapecachesize", GetShapeCacheSize);
+	RegisterLuaFunction(State, "clearshapecache", ClearShapeCache);
+}
 
-	RegisterEnum(State, "patterntype", {
-		{"SOLID", CAIRO_PATTERN_TYPE_SOLID},
-		{"SURFACE", CAIRO_PATTERN_TYPE_SURFACE},
-		{"LINEAR", CAIRO_PATTERN_TYPE_LINEAR},
-		{"RADIAL", CAIRO_PATTERN_TYPE_RADIAL},
-	});
+inline void LoadSurfacePool(lua_State *State)
+{
+	RegisterLuaFunctionWithMetatable(State, "pooledimagesurface", CreatePooledImageSurface, AsUID(cairo_image_surface_create));
+	RegisterLuaFunction(State, "setsurfacepoollimit", SetSurfacePoolLimit);
+	RegisterLuaFunction(State, "clearsurfacepool", ClearSurfacePool);
+}
 
-	RegisterEnum(State, "regionoverlap", {
-		{"IN", CAIRO_REGION_OVERLAP_IN},
-		{"OUT", CAIRO_REGION_OVERLAP_OUT},
-		{"PART", CAIRO_REGION_OVERLAP_PART},
+#ifdef CAIRO_HAS_RECORDING_SURFACE
+inline void LoadRecordingSurfaces(lua_State *State)
+{
+	CreateLazyMetatable(State, AsUID(cairo_recording_surface_create), (UID)SurfaceMetatable, [](lua_State *State)
+	{
+		RegisterMultipleReturn(State, "inkextents", cairo_recording_surface_ink_extents);
+		//Register(State, "getextents", cairo_recording_surface_get_extents); // 1.12
 	});
+	SetMetatableGarbageCollector(State, AsUID(cairo_recording_surface_create), ReleaseSurface);
+	RegisterLuaFunctionWithMetatable(State, "recordingsurface", CreateRecordingSurface, AsUID(cairo_recording_surface_create));
+}
+#endif
 
-	RegisterEnum(State, "devicetype", {
-		{"DRM", CAIRO_DEVICE_TYPE_DRM},
-		{"GL", CAIRO_DEVICE_TYPE_GL},
-		{"SCRIPT", CAIRO_DEVICE_TYPE_SCRIPT},
-		{"XCB", CAIRO_DEVICE_TYPE_XCB},
-		{"XLIB", CAIRO_DEVICE_TYPE_XLIB},
-		{"XML", CAIRO_DEVICE_TYPE_XML},
+#ifdef CAIRO_HAS_SVG_SURFACE
+inline void LoadSVGSurfaces(lua_State *State)
+{
+	CreateLazyMetatable(State, AsUID(cairo_svg_surface_create), (UID)SurfaceMetatable, [](lua_State *State)
+	{
+		Register(State, "restricttoversion", cairo_svg_surface_restrict_to_version);
 	});
+	SetMetatableGarbageCollector(State, AsUID(cairo_svg_surface_create), ReleaseSurface);
+	Register(State, "svgsurface", cairo_svg_surface_create);
+}
+#endif
 
-	RegisterEnum(State, "content", {
-		{"COLOR", CAIRO_CONTENT_COLOR},
-		{"ALPHA", CAIRO_CONTENT_ALPHA},
-		{"COLORALPHA", CAIRO_CONTENT_COLOR_ALPHA},
-	});
+// Enums and the less used constructors are created on first access
+constexpr LazyEnum LazyCairoEnums[] = 
+{
+	MakeLazyEnum("antialias", AntialiasValues),
+	MakeLazyEnum("fillrule", FillRuleValues),
+	MakeLazyEnum("linecap", LineCapValues),
+	MakeLazyEnum("linejoin", LineJoinValues),
+	MakeLazyEnum("operator", OperatorValues),
+	MakeLazyEnum("path", PathDataValues),
+	MakeLazyEnum("extend", ExtendValues),
+	MakeLazyEnum("filter", FilterValues),
+	MakeLazyEnum("patterntype", PatternTypeValues),
+	MakeLazyEnum("regionoverlap", RegionOverlapValues),
+	MakeLazyEnum("devicetype", DeviceTypeValues),
+	MakeLazyEnum("content", ContentValues),
+	MakeLazyEnum("surfacetype", SurfaceTypeValues),
+	MakeLazyEnum("format", FormatValues),
+	MakeLazyEnum("fontslant", FontSlantValues),
+	MakeLazyEnum("fontweight", FontWeightValues),
+	MakeLazyEnum("fonttype", FontTypeValues),
+#ifdef CAIRO_HAS_SVG_SURFACE
+	MakeLazyEnum("svgversion", SVGVersionValues),
+#endif
+};
 
+LazyField const LazyCairoFields[] = 
+{
+	{"rgbpattern", LoadPatterns},
+	{"rgbapattern", LoadPatterns},
+	{"linearpattern", LoadPatterns},
+	{"radialpattern", LoadPatterns},
+	{"surfacepattern", LoadPatterns},
+	{"region", LoadRegions},
+	{"rectanglecairoregion", LoadRegions},
+	{"cairoregionfromrectangles", LoadRegions},
+	{"matrix", LoadMatrices},
+	{"identitymatrix", LoadMatrices},
+	{"translatematrix", LoadMatrices},
+	{"scalematrix", LoadMatrices},
+	{"rotatematrix", LoadMatrices},
+	{"toyfontface", LoadFonts},
+	{"scaledfont", LoadFonts},
+	{"setlayercachebudget", LoadLayerCache},
+	{"getlayercachesize", LoadLayerCache},
+	{"clearlayercache", LoadLayerCache},
+	{"defineshape", LoadShapeCache},
+	{"setshapecachebudget", LoadShapeCache},
+	{"getshapecachesize", LoadShapeCache},
+	{"clearshapecache", LoadShapeCache},
+	{"pooledimagesurface", LoadSurfacePool},
+	{"setsurfacepoollimit", LoadSurfacePool},
+	{"clearsurfacepool", LoadSurfacePool},
+#ifdef CAIRO_HAS_RECORDING_SURFACE
+	{"recordingsurface", LoadRecordingSurfaces},
+#endif
+#ifdef CAIRO_HAS_SVG_SURFACE
+	{"svgsurface", LoadSVGSurfaces},
+#endif
+};
 
-	RegisterEnum(State, "surfacetype", {
-		{"IMAGE", CAIRO_SURFACE_TYPE_IMAGE},
-		{"PDF", CAIRO_SURFACE_TYPE_PDF},
-		{"PS", CAIRO_SURFACE_TYPE_PS},
-		{"XLIB", CAIRO_SURFACE_TYPE_XLIB},
-		{"XCB", CAIRO_SURFACE_TYPE_XCB},
-		{"GLITZ", CAIRO_SURFACE_TYPE_GLITZ},
-		{"QUARTZ", CAIRO_SURFACE_TYPE_QUARTZ},
-		{"WIN32", CAIRO_SURFACE_TYPE_WIN32},
-		{"BEOS", CAIRO_SURFACE_TYPE_BEOS},
-		{"DIRECTFB", CAIRO_SURFACE_TYPE_DIRECTFB},
-		{"SVG", CAIRO_SURFACE_TYPE_SVG},
-		{"OS2", CAIRO_SURFACE_TYPE_OS2},
-		{"WIN32PRINTING", CAIRO_SURFACE_TYPE_WIN32_PRINTING},
-		{"QUARTZIMAGE", CAIRO_SURFACE_TYPE_QUARTZ_IMAGE},
-		{"SCRIPT", CAIRO_SURFACE_TYPE_SCRIPT},
-		{"QT", CAIRO_SURFACE_TYPE_QT},
-		{"RECORDING", CAIRO_SURFACE_TYPE_RECORDING},
-		{"VG", CAIRO_SURFACE_TYPE_VG},
-		{"GL", CAIRO_SURFACE_TYPE_GL},
-		{"DRM", CAIRO_SURFACE_TYPE_DRM},
-		{"TEE", CAIRO_SURFACE_TYPE_TEE},
-		{"XML", CAIRO_SURFACE_TYPE_XML},
-		{"SKIA", CAIRO_SURFACE_TYPE_SKIA},
-		{"SUBSURFACE", CAIRO_SURFACE_TYPE_SUBSURFACE},
-	});
+// Drops the per-state caches whose keys come from scripts, so the next script run in the state can't pick up what
+// an earlier one left behind.
+inline void ResetScriptCaches(lua_State *State)
+{
+	GetLayerCache(State)->Clear();
+	ResetShapes(State);
+}
 
-	RegisterEnum(State, "format", {
-		{"INVALID", CAIRO_FORMAT_INVALID},
-		{"ARGB32", CAIRO_FORMAT_ARGB32},
-		{"RGB24", CAIRO_FORMAT_RGB24},
-		{"A8", CAIRO_FORMAT_A8},
-		{"A1", CAIRO_FORMAT_A1},
-		{"RGB16565", CAIRO_FORMAT_RGB16_565}
-	});
+inline void RegisterEverything(lua_State *State)
+{
+#ifndef NDEBUG
+	unsigned int const InitialHeight = lua_gettop(State);
+#endif
+	lua_newtable(State);
+	SetLazyFields(State, LazyCairoFields, LazyCairoEnums);
 
 	Register(State, "statustostring", cairo_status_to_string);
+
+	CreateLazyMetatable(State, AsUID(CreateDoubleBuffer), [](lua_State *State)
+	{
+		RegisterLuaFunction(State, "get", GetDoubleBufferValue);
+		RegisterLuaFunction(State, "set", SetDoubleBufferValue);
+		RegisterLuaFunction(State, "size", GetDoubleBufferSize);
+		RegisterLuaFunction(State, "totable", DoubleBufferToTable);
+		RegisterLuaFunction(State, "tostring", DoubleBufferToString);
+	});
+	ExtendMetatable(State, AsUID(CreateDoubleBuffer), [&](void)
+	{
+		RegisterLuaFunction(State, "__len", GetDoubleBufferSize);
+	});
+	RegisterLuaFunctionWithMetatable(State, "buffer", CreateDoubleBuffer, AsUID(CreateDoubleBuffer));
 	
-	static UIDObject PatternMetatable;
-	static UIDObject SurfaceMetatable;
-	static UIDObject PathMetatable;
-	
-	CreateMetatable(State, AsUID(cairo_create), [&](void)
+	CreateLazyMetatable(State, AsUID(cairo_create), [](lua_State *State)
 	{
 		Register(State, "status", cairo_status);
 		Register(State, "save", cairo_save);
@@ -247,12 +618,12 @@ inline void RegisterEverything(lua_State *State)
 		Register(State, "pushgroup", cairo_push_group);
 		Register(State, "pushgroupwithcontent", cairo_push_group_with_content);
 		RegisterWithMetatable(State, "popgroup", cairo_pop_group, (UID)PatternMetatable);
-		Register(State, "popgrouptosource", cairo_pop_group_to_source);
+		Register(State, "popgrouptosource", PopGroupToSource);
 		RegisterWithMetatable(State, "getgrouptarget", Reference(cairo_get_group_target, cairo_surface_reference), (UID)SurfaceMetatable);
 		Register(State, "setsourcergb", cairo_set_source_rgb);
 		Register(State, "setsourcergba", cairo_set_source_rgba);
-		Register(State, "setsource", cairo_set_source);
-		Register(State, "setsourcesurface", cairo_set_source_surface);
+		Register(State, "setsource", SetSource);
+		Register(State, "setsourcesurface", SetSourceSurface);
 		RegisterWithMetatable(State, "getsource", Reference(cairo_get_source, cairo_pattern_reference), (UID)PatternMetatable);
 		Register(State, "setantialias", cairo_set_antialias);
 		Register(State, "getantialias", cairo_get_antialias);
@@ -284,8 +655,8 @@ inline void RegisterEverything(lua_State *State)
 		Register(State, "fillpreserve", cairo_fill_preserve);
 		RegisterMultipleReturn(State, "fillextents", cairo_fill_extents);
 		Register(State, "infill", cairo_in_fill);
-		Register(State, "mask", cairo_mask);
-		Register(State, "masksurface", cairo_mask_surface);
+		Register(State, "mask", Mask);
+		Register(State, "masksurface", MaskSurface);
 		Register(State, "paint", cairo_paint);
 		Register(State, "paintwithalpha", cairo_paint_with_alpha);
 		Register(State, "stroke", cairo_stroke);
@@ -310,12 +681,34 @@ inline void RegisterEverything(lua_State *State)
 		Register(State, "lineto", cairo_line_to);
 		Register(State, "moveto", cairo_move_to);
 		Register(State, "rectangle", cairo_rectangle);
-		Register(State, "glyphpath", cairo_glyph_path);
+		RegisterLuaFunction(State, "glyphpath", GlyphPath);
 		Register(State, "textpath", cairo_text_path);
 		Register(State, "relcurveto", cairo_rel_curve_to);
 		Register(State, "rellineto", cairo_rel_line_to);
 		Register(State, "relmoveto", cairo_rel_move_to);
 		RegisterMultipleReturn(State, "pathextents", cairo_path_extents);
+		RegisterMultipleReturnBundle(State, "extents", cairo_fill_extents, cairo_stroke_extents, cairo_path_extents, cairo_clip_extents);
+		RegisterLuaFunction(State, "polyline", BuildPolyline<false>);
+		RegisterLuaFunction(State, "polygon", BuildPolyline<true>);
+		RegisterLuaFunction(State, "pathcommands", BuildPath);
+		RegisterLuaFunction(State, "layercache", DrawCachedLayer);
+		RegisterLuaFunction(State, "drawcached", DrawCachedShape);
+		RegisterLuaFunction(State, "instances", DrawInstances);
+
+		// Text methods
+		Register(State, "selectfontface", cairo_select_font_face);
+		Register(State, "setfontsize", cairo_set_font_size);
+		Register(State, "setfontmatrix", cairo_set_font_matrix);
+		Register(State, "getfontmatrix", cairo_get_font_matrix);
+		Register(State, "setfontface", cairo_set_font_face);
+		RegisterWithMetatable(State, "getfontface", Reference(cairo_get_font_face, cairo_font_face_reference), (UID)FontFaceMetatable);
+		Register(State, "setscaledfont", cairo_set_scaled_font);
+		RegisterWithMetatable(State, "getscaledfont", Reference(cairo_get_scaled_font, cairo_scaled_font_reference), (UID)ScaledFontMetatable);
+		RegisterLuaFunction(State, "showtext", ShowText);
+		RegisterLuaFunction(State, "showglyphs", ShowGlyphs);
+		RegisterLuaFunction(State, "textextents", GetTextExtents);
+		RegisterLuaFunction(State, "fontextents", GetFontExtents);
+		RegisterLuaFunctionWithMetatable(State, "measuretexts", MeasureTexts, AsUID(CreateDoubleBuffer));
 
 		// Transformation methods
 		Register(State, "translate", cairo_translate);
@@ -333,10 +726,16 @@ inline void RegisterEverything(lua_State *State)
 	SetMetatableGarbageCollector(State, AsUID(cairo_create), cairo_destroy);
 	Register(State, "context", cairo_create);
 
-	CreateMetatable(State, PathMetatable, [](void) {});
+	CreateLazyMetatable(State, PathMetatable, [](lua_State *State)
+	{
+		RegisterLuaFunction(State, "status", GetPathStatus);
+		RegisterLuaFunction(State, "getoperations", GetPathOperations);
+		RegisterLuaFunctionWithMetatable(State, "getcoordinates", GetPathCoordinates, AsUID(CreateDoubleBuffer));
+	});
 	SetMetatableGarbageCollector(State, PathMetatable, cairo_path_destroy);
+	RegisterLuaFunctionWithMetatable(State, "packedpath", CreatePackedPath, PathMetatable);
 
-	CreateMetatable(State, (UID)PatternMetatable, [&](void)
+	CreateLazyMetatable(State, (UID)PatternMetatable, [](lua_State *State)
 	{
 		Register(State, "status", cairo_pattern_status);
 		Register(State, "setextend", cairo_pattern_set_extend);
@@ -384,123 +783,72 @@ inline void RegisterEverything(lua_State *State)
 	});
 	SetMetatableGarbageCollector(State, (UID)PatternMetatable, cairo_pattern_destroy);
 
-	RegisterWithMetatable(State, "rgbpattern", cairo_pattern_create_rgb, (UID)PatternMetatable);
-	RegisterWithMetatable(State, "rgbapattern", cairo_pattern_create_rgba, (UID)PatternMetatable);
-		
-	RegisterWithMetatable(State, "linearpattern", cairo_pattern_create_linear, (UID)PatternMetatable);
-		
-	RegisterWithMetatable(State, "radialpattern", cairo_pattern_create_radial, (UID)PatternMetatable);
-		
-	RegisterWithMetatable(State, "surfacepattern", cairo_pattern_create_for_surface, (UID)PatternMetatable);
-		
-	//RegisterWithMetatable(State, "createmesh", cairo_pattern_create_mesh, (UID)PatternMetatable); // 1.12 
-
-	// Regions
-	CreateMetatable(State, AsUID(cairo_region_create), [&](void)
+	CreateLazyMetatable(State, (UID)FontFaceMetatable, [](lua_State *State)
 	{
-		Register(State, "copy", cairo_region_copy);
-		Register(State, "status", cairo_region_status);
-		Register(State, "getextents", cairo_region_get_extents);
-		Register(State, "numrectangles", cairo_region_num_rectangles);
-		Register(State, "getrectangle", cairo_region_get_rectangle);
-		Register(State, "isempty", cairo_region_is_empty);
-		Register(State, "containspoint", cairo_region_contains_point);
-		Register(State, "containsrectangle", cairo_region_contains_rectangle);
-		Register(State, "equal", cairo_region_equal);
-		Register(State, "translate", cairo_region_translate);
-		Register(State, "intersect", cairo_region_intersect);
-		Register(State, "intersectrectangle", cairo_region_intersect_rectangle);
-		Register(State, "subtract", cairo_region_subtract);
-		Register(State, "subtractrectangle", cairo_region_subtract_rectangle);
-		Register(State, "union", cairo_region_union);
-		Register(State, "unionrectangle", cairo_region_union_rectangle);
-		Register(State, "xor", cairo_region_xor);
-		Register(State, "xorrectangle", cairo_region_xor_rectangle);
+		Register(State, "status", cairo_font_face_status);
+		Register(State, "gettype", cairo_font_face_get_type);
+
+		// Toy font faces only
+		Register(State, "getfamily", cairo_toy_font_face_get_family);
+		Register(State, "getslant", cairo_toy_font_face_get_slant);
+		Register(State, "getweight", cairo_toy_font_face_get_weight);
 	});
-	SetMetatableGarbageCollector(State, AsUID(cairo_region_create), cairo_region_destroy);
-	Register(State, "region", cairo_region_create);
-	RegisterWithMetatable(State, "rectanglecairoregion", cairo_region_create_rectangle, AsUID(cairo_region_create));
-	RegisterWithMetatable(State, "cairoregionfromrectangles", cairo_region_create_rectangles, AsUID(cairo_region_create));
+	SetMetatableGarbageCollector(State, (UID)FontFaceMetatable, cairo_font_face_destroy);
 
-	// Matrices
-	CreateMetatable(State, AsUID(CreateMatrix), [&](void)
+	CreateLazyMetatable(State, (UID)ScaledFontMetatable, [](lua_State *State)
 	{
-		Register(State, "init", cairo_matrix_init);
-		Register(State, "initidentity", cairo_matrix_init_identity);
-		Register(State, "inittranslate", cairo_matrix_init_translate);
-		Register(State, "initscale", cairo_matrix_init_scale);
-		Register(State, "initrotate", cairo_matrix_init_rotate);
-		Register(State, "translate", cairo_matrix_translate);
-		Register(State, "scale", cairo_matrix_scale);
-		Register(State, "rotate", cairo_matrix_rotate);
-		Register(State, "invert", cairo_matrix_invert);
-		Register(State, "multiply", cairo_matrix_multiply);
-		RegisterInputOutput(State, "transformdistance", cairo_matrix_transform_distance);
-		RegisterInputOutput(State, "transformpoint", cairo_matrix_transform_point);
+		Register(State, "status", cairo_scaled_font_status);
+		Register(State, "gettype", cairo_scaled_font_get_type);
+		RegisterWithMetatable(State, "getfontface", Reference(cairo_scaled_font_get_font_face, cairo_font_face_reference), (UID)FontFaceMetatable);
+		Register(State, "getfontmatrix", cairo_scaled_font_get_font_matrix);
+		Register(State, "getctm", cairo_scaled_font_get_ctm);
+		RegisterLuaFunction(State, "texttoglyphs", ScaledFontTextToGlyphs);
+		RegisterLuaFunction(State, "textextents", GetScaledFontTextExtents);
+		RegisterLuaFunction(State, "fontextents", GetScaledFontExtents);
 	});
-	SetMetatableGarbageCollector(State, AsUID(CreateMatrix), DestroyMatrix);
-	Register(State, "matrix", CreateMatrix);
-	RegisterWithMetatable(State, "identitymatrix", CreateIdentityMatrix, AsUID(CreateMatrix));
-	RegisterWithMetatable(State, "translatematrix", CreateTranslateMatrix, AsUID(CreateMatrix));
-	RegisterWithMetatable(State, "scalematrix", CreateScaleMatrix, AsUID(CreateMatrix));
-	RegisterWithMetatable(State, "rotatematrix", CreateRotateMatrix, AsUID(CreateMatrix));
-	
-	CreateMetatable(State, (UID)SurfaceMetatable, [&](void)
+	SetMetatableGarbageCollector(State, (UID)ScaledFontMetatable, cairo_scaled_font_destroy);
+
+	CreateLazyMetatable(State, (UID)SurfaceMetatable, [](lua_State *State)
 	{
 		RegisterSurfaceMethods(State);
 	});
-	SetMetatableGarbageCollector(State, (UID)SurfaceMetatable, cairo_surface_destroy);
-	Register(State, "similarsurface", cairo_surface_create_similar);
+	SetMetatableGarbageCollector(State, (UID)SurfaceMetatable, ReleaseSurface);
+	RegisterWithMetatable(State, "similarsurface", cairo_surface_create_similar, (UID)SurfaceMetatable);
 	//RegisterWithMetatable(State, "similarimagesurface", cairo_surface_create_similar_image, (UID)SurfaceMetatable); // 1.12
 	RegisterWithMetatable(State, "rectanglesurface", cairo_surface_create_for_rectangle, (UID)SurfaceMetatable);
 
 #ifdef CAIRO_HAS_IMAGE_SURFACE
-	CreateMetatable(State, AsUID(cairo_image_surface_create), [&](void)
+	CreateLazyMetatable(State, AsUID(cairo_image_surface_create), (UID)SurfaceMetatable, [](lua_State *State)
 	{
-		RegisterSurfaceMethods(State);
-		Register(State, "getdata", cairo_image_surface_get_data);
+		RegisterWithMetatable(State, "getdata", GetImageData, AsUID(GetImageData));
+		RegisterLuaFunction(State, "replayparallel", ReplayParallel);
 		Register(State, "getformat", cairo_image_surface_get_format);
 		Register(State, "getwidth", cairo_image_surface_get_width);
 		Register(State, "getheight", cairo_image_surface_get_height);
 		Register(State, "getstride", cairo_image_surface_get_stride);
 	});
-	SetMetatableGarbageCollector(State, AsUID(cairo_image_surface_create), cairo_surface_destroy);
+	SetMetatableGarbageCollector(State, AsUID(cairo_image_surface_create), ReleaseSurface);
 	Register(State, "imagesurface", cairo_image_surface_create);
-#endif
 
-#ifdef CAIRO_HAS_PNG_FUNCTIONS
-	CreateMetatable(State, AsUID(cairo_image_surface_create_from_png), [&](void)
+	CreateLazyMetatable(State, AsUID(GetImageData), [](lua_State *State)
 	{
-		RegisterSurfaceMethods(State);
+		Register(State, "getformat", GetImageDataFormat);
+		Register(State, "getwidth", GetImageDataWidth);
+		Register(State, "getheight", GetImageDataHeight);
+		Register(State, "getstride", GetImageDataStride);
+		RegisterLuaFunction(State, "getrows", GetImageDataRows);
+		RegisterLuaFunction(State, "setrows", SetImageDataRows);
+		RegisterLuaFunction(State, "tostring", GetImageDataString);
+		Register(State, "markdirty", MarkImageDataDirty);
 	});
-	SetMetatableGarbageCollector(State, AsUID(cairo_image_surface_create_from_png), cairo_surface_destroy);
-	Register(State, "imagesurfacefrompng", cairo_image_surface_create_from_png);
+	SetMetatableGarbageCollector(State, AsUID(GetImageData), DestroyImageData);
 #endif
 
-#ifdef CAIRO_HAS_RECORDING_SURFACE
-	CreateMetatable(State, AsUID(cairo_recording_surface_create), [&](void)
-	{
-		RegisterSurfaceMethods(State);
-		RegisterMultipleReturn(State, "inkextents", cairo_recording_surface_ink_extents);
-		//Register(State, "getextents", cairo_recording_surface_get_extents); // 1.12
-	});
-	SetMetatableGarbageCollector(State, AsUID(cairo_recording_surface_create), cairo_surface_destroy);
-	Register(State, "recordingsurface", cairo_recording_surface_create);
-#endif
-
-#ifdef CAIRO_HAS_SVG_SURFACE
-	RegisterEnum(State, "svgversion", {
-		{"11", CAIRO_SVG_VERSION_1_1},
-		{"12", CAIRO_SVG_VERSION_1_2},
-	});
-
-	CreateMetatable(State, AsUID(cairo_svg_surface_create), [&](void)
-	{
-		RegisterSurfaceMethods(State);
-		Register(State, "restricttoversion", cairo_svg_surface_restrict_to_version);
-	});
-	SetMetatableGarbageCollector(State, AsUID(cairo_svg_surface_create), cairo_surface_destroy);
-	Register(State, "svgsurface", cairo_svg_surface_create);
+#ifdef CAIRO_HAS_PNG_FUNCTIONS
+	// Loaded PNGs are image surfaces
+	RegisterWithMetatable(State, "imagesurfacefrompng", cairo_image_surface_create_from_png, AsUID(cairo_image_surface_create));
+	RegisterLuaFunctionWithMetatable(State, "imagesurfacefrompngstring", CreateImageSurfaceFromPNGString, AsUID(cairo_image_surface_create));
+	RegisterLuaFunctionWithMetatable(State, "imagesurfacefrompngstream", CreateImageSurfaceFromPNGStream, AsUID(cairo_image_surface_create));
 #endif
 
 #ifndef NDEBUG
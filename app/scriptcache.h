@@ -0,0 +1,183 @@
+#ifndef scriptcache_h
+#define scriptcache_h
+
+#include <string>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern "C"
+{
+	#include <lua.h>
+	#include <lauxlib.h>
+}
+
+// Compiled chunk cache
+// Scripts are compiled once and the bytecode (from lua_dump) reused while the path, modification time and content
+// hash all match.  Entries are kept in memory and, if a directory is given, on disk so separate runs share them.
+// Safe to use from several threads at once.
+class ScriptCache
+{
+	public:
+		ScriptCache(std::string const &Directory = std::string()) : Directory(Directory), TemporaryCount(0) {}
+
+		// Pushes the loaded chunk (or an error message) and returns the Lua load status
+		int Load(lua_State *State, std::string const &Path)
+		{
+			struct stat Status;
+			std::string Source;
+			if ((stat(Path.c_str(), &Status) != 0) || !ReadFile(Path, Source))
+				return luaL_loadfile(State, Path.c_str());
+
+			std::string const ChunkName = "@" + Path;
+			Key const Current = {(int64_t)Status.st_mtime, Hash(Source)};
+
+			// Headers are handled like luaL_loadfile does: a UTF-8 byte order mark is skipped and a leading # line
+			// blanked, keeping line numbers.  Precompiled scripts are left to luaL_loadfile, there's nothing to cache.
+			size_t Start = Source.compare(0, 3, "\xEF\xBB\xBF") == 0 ? 3 : 0;
+			if ((Start < Source.size()) && (Source[Start] == '#'))
+				Start = std::min(Source.find('\n', Start), Source.size());
+			if ((Start < Source.size()) && (Source[Start] == LUA_SIGNATURE[0]))
+				return luaL_loadfile(State, Path.c_str());
+			Source.erase(0, Start);
+
+			std::string Bytecode;
+			if (Find(Path, Current, Bytecode))
+			{
+				int Result = luaL_loadbufferx(State, Bytecode.data(), Bytecode.size(), ChunkName.c_str(), "b");
+				if (Result == LUA_OK) return Result;
+				lua_pop(State, 1); // Written by an incompatible Lua build, recompile
+			}
+
+			int Result = luaL_loadbufferx(State, Source.data(), Source.size(), ChunkName.c_str(), "t");
+			if (Result != LUA_OK) return Result;
+
+			Bytecode.clear();
+			lua_dump(State, DumpWriter, &Bytecode);
+			Store(Path, Current, Bytecode);
+			return LUA_OK;
+		}
+
+	private:
+		struct Key
+		{
+			int64_t ModifiedTime;
+			uint64_t Hash;
+
+			bool operator ==(Key const &Other) const { return (ModifiedTime == Other.ModifiedTime) && (Hash == Other.Hash); }
+		};
+
+		struct Entry
+		{
+			Key Version;
+			std::string Bytecode;
+		};
+
+		static uint64_t Hash(std::string const &Data)
+		{
+			// FNV-1a
+			uint64_t Out = 14695981039346656037ull;
+			for (unsigned char Byte : Data) Out = (Out ^ Byte) * 1099511628211ull;
+			return Out;
+		}
+
+		static bool ReadFile(std::string const &Path, std::string &Out)
+		{
+			std::ifstream File(Path.c_str(), std::ios::binary);
+			if (!File) return false;
+			std::ostringstream Contents;
+			Contents << File.rdbuf();
+			Out = Contents.str();
+			return true;
+		}
+
+		static int DumpWriter(lua_State *, void const *Data, size_t Size, void *Out)
+		{
+			static_cast<std::string *>(Out)->append(static_cast<char const *>(Data), Size);
+			return 0;
+		}
+
+		std::string DiskPath(std::string const &Path) const
+		{
+			char Name[32];
+			snprintf(Name, sizeof(Name), "%016llx.luac", (unsigned long long)Hash(Path));
+			return Directory + "/" + Name;
+		}
+
+		bool Find(std::string const &Path, Key const &Version, std::string &Bytecode)
+		{
+			{
+				std::lock_guard<std::mutex> Lock(Mutex);
+				auto Found = Entries.find(Path);
+				if ((Found != Entries.end()) && (Found->second.Version == Version))
+				{
+					Bytecode = Found->second.Bytecode;
+					return true;
+				}
+			}
+
+			// Disk entries are the path, the key, the bytecode's hash and then the bytecode.  Lua doesn't verify
+			// bytecode, so damaged entries have to be caught here rather than crash the interpreter.
+			if (Directory.empty()) return false;
+			std::string Contents;
+			if (!ReadFile(DiskPath(Path), Contents)) return false;
+			size_t const HeaderSize = Path.size() + 1 + sizeof(Key) + sizeof(uint64_t);
+			if ((Contents.size() < HeaderSize) || (Contents.compare(0, Path.size() + 1, Path.c_str(), Path.size() + 1) != 0))
+				return false;
+			Key Stored;
+			memcpy(&Stored, Contents.data() + Path.size() + 1, sizeof(Key));
+			if (!(Stored == Version)) return false;
+			uint64_t BytecodeHash;
+			memcpy(&BytecodeHash, Contents.data() + Path.size() + 1 + sizeof(Key), sizeof(BytecodeHash));
+			Bytecode = Contents.substr(HeaderSize);
+			if (Hash(Bytecode) != BytecodeHash) return false;
+
+			std::lock_guard<std::mutex> Lock(Mutex);
+			Entries[Path] = Entry{Version, Bytecode};
+			return true;
+		}
+
+		void Store(std::string const &Path, Key const &Version, std::string const &Bytecode)
+		{
+			{
+				std::lock_guard<std::mutex> Lock(Mutex);
+				Entries[Path] = Entry{Version, Bytecode};
+			}
+
+			// Written under a unique name and renamed into place so concurrent readers never see partial entries
+			if (Directory.empty()) return;
+			std::string const Final = DiskPath(Path);
+			std::string const Temporary = Final + "." + std::to_string(getpid()) + "." + std::to_string(TemporaryCount++);
+			{
+				std::ofstream File(Temporary.c_str(), std::ios::binary | std::ios::trunc);
+				if (!File) return;
+				File.write(Path.c_str(), Path.size() + 1);
+				File.write(reinterpret_cast<char const *>(&Version), sizeof(Key));
+				uint64_t const BytecodeHash = Hash(Bytecode);
+				File.write(reinterpret_cast<char const *>(&BytecodeHash), sizeof(BytecodeHash));
+				File.write(Bytecode.data(), Bytecode.size());
+				if (!File)
+				{
+					File.close();
+					remove(Temporary.c_str());
+					return;
+				}
+			}
+			if (rename(Temporary.c_str(), Final.c_str()) != 0) remove(Temporary.c_str());
+		}
+
+		std::string const Directory;
+		std::mutex Mutex;
+		std::map<std::string, Entry> Entries;
+		std::atomic<unsigned int> TemporaryCount;
+};
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef shapecache_h
+#define shapecache_h
+
+#include <string>
+
+#include "cache.h"
+
+// Shape cache
+// cairo.defineshape(name, build) registers a parametric shape.  context:drawcached(name, x, y, ...) appends the shape
+// to the current path with its origin at x, y: the first time for a set of parameters (the numbers after y) build is
+// called with a scratch context and those parameters, and the path it builds is kept; later calls only append the
+// kept path.  Paths are evicted least recently used first once their total size passes the budget
+// (cairo.setshapecachebudget, in bytes).  Defining a shape drops every kept path.
+struct ShapeCache
+{
+	ShapeCache(size_t Budget) : Paths(Budget, &DestroyPath), Scratch(cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1)) {}
+	~ShapeCache(void) { cairo_surface_destroy(Scratch); }
+
+	static void DestroyPath(cairo_path_t *&Path) { cairo_path_destroy(Path); }
+
+	LRUCache<std::string, cairo_path_t *> Paths;
+	cairo_surface_t *Scratch;
+};
+
+static UIDObject ShapeCacheKey;
+static UIDObject ShapeDefinitionsKey;
+size_t const DefaultShapeCacheBudget = 8 << 20;
+
+inline ShapeCache *GetShapeCache(lua_State *State)
+	{ return GetStateObject<ShapeCache>(State, ShapeCacheKey, DefaultShapeCacheBudget); }
+
+// Pushes the table of shape builders, by name
+inline void PushShapeDefinitions(lua_State *State)
+{
+	lua_pushlightuserdata(State, (UID)ShapeDefinitionsKey);
+	lua_rawget(State, LUA_REGISTRYINDEX);
+	if (!lua_isnil(State, -1)) return;
+	lua_pop(State, 1);
+	lua_newtable(State);
+	lua_pushlightuserdata(State, (UID)ShapeDefinitionsKey);
+	lua_pushvalue(State, -2);
+	lua_rawset(State, LUA_REGISTRYINDEX);
+}
+
+static int DefineShape(lua_State *State)
+{
+	luaL_checkstring(State, 1);
+	luaL_checktype(State, 2, LUA_TFUNCTION);
+	PushShapeDefinitions(State);
+	lua_pushvalue(State, 1);
+	lua_pushvalue(State, 2);
+	lua_rawset(State, -3);
+	GetShapeCache(State)->Paths.Clear();
+	return 0;
+}
+
+static int DrawCachedShape(lua_State *State)
+{
+	cairo_t *Context = LuaValue<cairo_t *>::Read(State, 1);
+	size_t NameLength;
+	char const *Name = luaL_checklstring(State, 2, &NameLength);
+	double const X = LuaValue<double>::Read(State, 3);
+	double const Y = LuaValue<double>::Read(State, 4);
+	int const ParameterCount = lua_gettop(State) - 4;
+
+	PushShapeDefinitions(State);
+	lua_pushvalue(State, 2);
+	lua_rawget(State, -2);
+	if (!lua_isfunction(State, -1)) return luaL_error(State, "There is no shape named \"%s\".", Name);
+	int const Builder = lua_gettop(State);
+
+	// The key is the name followed by the raw parameter values
+	std::string Key(Name, NameLength + 1);
+	for (int Index = 0; Index < ParameterCount; ++Index)
+	{
+		double Parameter = LuaValue<double>::Read(State, 5 + Index);
+		Key.append(reinterpret_cast<char const *>(&Parameter), sizeof(Parameter));
+	}
+
+	ShapeCache *Cache = GetShapeCache(State);
+	cairo_path_t **Path = Cache->Paths.Find(Key);
+	if (Path == nullptr)
+	{
+		// The scratch context belongs to Lua from here on
+		luaL_checkstack(State, ParameterCount + 3, "Too many shape parameters.");
+		cairo_t *ScratchContext = cairo_create(Cache->Scratch);
+		lua_pushvalue(State, Builder);
+		PushMetatable(State, AsUID(cairo_create));
+		LuaValue<cairo_t *>::Write(State, lua_gettop(State), ScratchContext);
+		lua_remove(State, -2);
+		for (int Index = 0; Index < ParameterCount; ++Index)
+			lua_pushvalue(State, 5 + Index);
+		lua_call(State, 1 + ParameterCount, 0);
+
+		cairo_path_t *Built = cairo_copy_path(ScratchContext);
+		if (Built->status != CAIRO_STATUS_SUCCESS)
+		{
+			cairo_status_t Status = Built->status;
+			cairo_path_destroy(Built);
+			return luaL_error(State, "Building shape \"%s\" failed: %s", Name, cairo_status_to_string(Status));
+		}
+		Path = &Cache->Paths.Insert(Key, Built, sizeof(cairo_path_t) + Built->num_data * sizeof(cairo_path_data_t));
+	}
+
+	cairo_matrix_t Matrix;
+	cairo_get_matrix(Context, &Matrix);
+	cairo_translate(Context, X, Y);
+	cairo_append_path(Context, *Path);
+	cairo_set_matrix(Context, &Matrix);
+	return 0;
+}
+
+// Forgets every shape definition and kept path
+inline void ResetShapes(lua_State *State)
+{
+	lua_pushlightuserdata(State, (UID)ShapeDefinitionsKey);
+	lua_pushnil(State);
+	lua_rawset(State, LUA_REGISTRYINDEX);
+	GetShapeCache(State)->Paths.Clear();
+}
+
+static int SetShapeCacheBudget(lua_State *State)
+{
+	lua_Number Budget = LuaValue<double>::Read(State, 1);
+	if (Budget < 0) return luaL_error(State, "Shape cache budget must not be negative.");
+	GetShapeCache(State)->Paths.SetBudget((size_t)Budget);
+	return 0;
+}
+
+static int GetShapeCacheSize(lua_State *State)
+{
+	// Returns bytes used, path count and budget
+	ShapeCache *Cache = GetShapeCache(State);
+	lua_pushnumber(State, Cache->Paths.GetSize());
+	lua_pushinteger(State, Cache->Paths.GetCount());
+	lua_pushnumber(State, Cache->Paths.GetBudget());
+	return 3;
+}
+
+static int ClearShapeCache(lua_State *State)
+{
+	GetShapeCache(State)->Paths.Clear();
+	return 0;
+}
+
+#endif
@@ -1,6 +1,17 @@
 #include <string>
 #include <iostream>
+#include <sstream>
 #include <cassert>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 extern "C"
 {
@@ -12,62 +23,376 @@ extern "C"
 extern "C"
 {
 	int LUA_API luaopen_cairo(lua_State *State);
+	void LUA_API luacairo_resetcaches(lua_State *State);
 }
 
-int main(int ArgumentCount, char **Arguments)
+#include "scriptcache.h"
+
+// Creates a state with the standard libraries loaded and cairo required
+lua_State *CreateState(void)
 {
 	lua_State *State = luaL_newstate();
+	if (State == nullptr) throw std::string("Failed to create Lua state.");
 	assert(lua_gettop(State) == 0);
-	try
+	luaL_openlibs(State);
+	assert(lua_gettop(State) == 0);
+
+	luaL_requiref(State, "cairo", luaopen_cairo, true);
+	lua_pop(State, 1);
+	assert(lua_gettop(State) == 0);
+	return State;
+}
+
+//-- Job isolation
+// The global table, each table in it (the standard libraries, cairo, package) and package.loaded are snapshotted
+// before the first isolated job and restored before each later one.  Restoring is one level deep, so changes to
+// tables nested further in, metatables or the registry still carry over.
+static char SharedTablesKey;
+
+// Adds a shallow copy of the table at Table to the table at Snapshots, keyed by the table itself
+void SnapshotTable(lua_State *State, int Snapshots, int Table)
+{
+	lua_pushvalue(State, Table);
+	lua_rawget(State, Snapshots);
+	bool const Known = !lua_isnil(State, -1);
+	lua_pop(State, 1);
+	if (Known) return;
+	lua_pushvalue(State, Table);
+	lua_newtable(State);
+	lua_pushnil(State);
+	while (lua_next(State, Table) != 0)
 	{
-		if (ArgumentCount < 2)
-			throw std::string("You must specify a Lua script as the first argument.");
+		lua_pushvalue(State, -2);
+		lua_insert(State, -2);
+		lua_rawset(State, -4);
+	}
+	lua_rawset(State, Snapshots);
+}
 
-		if (State == nullptr) throw std::string("Failed to create Lua state.");
-		luaL_openlibs(State);
-		assert(lua_gettop(State) == 0);
+void SnapshotSharedTables(lua_State *State)
+{
+	lua_newtable(State);
+	int const Snapshots = lua_gettop(State);
+	lua_pushglobaltable(State);
+	int const Globals = lua_gettop(State);
+	SnapshotTable(State, Snapshots, Globals);
+	lua_pushnil(State);
+	while (lua_next(State, Globals) != 0)
+	{
+		if (lua_istable(State, -1)) SnapshotTable(State, Snapshots, lua_gettop(State));
+		lua_pop(State, 1);
+	}
+	lua_pushliteral(State, "package");
+	lua_rawget(State, Globals);
+	if (lua_istable(State, -1))
+	{
+		lua_pushliteral(State, "loaded");
+		lua_rawget(State, -2);
+		if (lua_istable(State, -1)) SnapshotTable(State, Snapshots, lua_gettop(State));
+	}
+	lua_settop(State, Snapshots);
+	lua_rawsetp(State, LUA_REGISTRYINDEX, &SharedTablesKey);
+}
 
-		luaL_requiref(State, "cairo", luaopen_cairo, true);
+void RestoreSharedTables(lua_State *State)
+{
+	lua_rawgetp(State, LUA_REGISTRYINDEX, &SharedTablesKey);
+	int const Snapshots = lua_gettop(State);
+	lua_pushnil(State);
+	while (lua_next(State, Snapshots) != 0)
+	{
+		int const Copy = lua_gettop(State), Table = Copy - 1;
+
+		// Drop the fields the last job added, then put back the rest
+		lua_pushnil(State);
+		while (lua_next(State, Table) != 0)
+		{
+			lua_pop(State, 1);
+			lua_pushvalue(State, -1);
+			lua_rawget(State, Copy);
+			bool const Added = lua_isnil(State, -1);
+			lua_pop(State, 1);
+			if (!Added) continue;
+			lua_pushvalue(State, -1);
+			lua_pushnil(State);
+			lua_rawset(State, Table);
+		}
+		lua_pushnil(State);
+		while (lua_next(State, Copy) != 0)
+		{
+			lua_pushvalue(State, -2);
+			lua_insert(State, -2);
+			lua_rawset(State, Table);
+		}
+		lua_pop(State, 1);
+	}
+	lua_pop(State, 1);
+}
+
+// Runs a script with arg set to the script and its arguments.  If Isolate is set the shared tables are restored (see
+// above), the layer and shape caches are emptied and the script gets its own global environment (falling back to the
+// shared one), so jobs sharing a state don't see each other's globals, required modules or cached drawing.
+// Scripts are loaded through Cache if there is one.
+void RunScript(lua_State *State, ScriptCache *Cache, std::string const &Script, std::vector<std::string> const &Arguments, bool Isolate)
+{
+	assert(lua_gettop(State) == 0);
+	if (Isolate)
+	{
+		lua_rawgetp(State, LUA_REGISTRYINDEX, &SharedTablesKey);
+		bool const First = lua_isnil(State, -1);
 		lua_pop(State, 1);
-		assert(lua_gettop(State) == 0);
+		if (First) SnapshotSharedTables(State);
+		else RestoreSharedTables(State);
+		luacairo_resetcaches(State);
+	}
+	lua_getglobal(State, "debug");
+	lua_getfield(State, -1, "traceback");
+	lua_remove(State, -2);
+
+	int LoadError = Cache != nullptr ? Cache->Load(State, Script) : luaL_loadfile(State, Script.c_str());
+	if (LoadError != LUA_OK)
+	{
+		std::string Error = std::string("Unable to open script file; Error was:\n\n") + lua_tostring(State, -1);
+		lua_settop(State, 0);
+		throw Error;
+	}
+	assert(lua_isfunction(State, 2));
 
-		// Set arguments table
-#ifndef NDEBUG
-		unsigned int const InitialHeight = lua_gettop(State);
-#endif
+	// Set arguments table
+	lua_newtable(State);
+	lua_pushstring(State, Script.c_str());
+	lua_rawseti(State, -2, 0);
+	for (unsigned int CurrentArgument = 0; CurrentArgument < Arguments.size(); ++CurrentArgument)
+	{
+		lua_pushstring(State, Arguments[CurrentArgument].c_str());
+		lua_rawseti(State, -2, CurrentArgument + 1);
+	}
+	if (Isolate)
+	{
 		lua_newtable(State);
-		for (unsigned int CurrentArgument = 2; CurrentArgument < (unsigned int)ArgumentCount; ++CurrentArgument)
+		lua_insert(State, -2);
+		lua_setfield(State, -2, "arg");
+		lua_newtable(State);
+		lua_pushstring(State, "__index");
+		lua_pushglobaltable(State);
+		lua_settable(State, -3);
+		lua_setmetatable(State, -2);
+		lua_setupvalue(State, 2, 1); // _ENV
+	}
+	else lua_setglobal(State, "arg");
+	assert(lua_gettop(State) == 2);
+
+	int Result = lua_pcall(State, 0, 0, 1);
+	if (Result != LUA_OK)
+	{
+		std::string Error = std::string("Error while running script; Error was:\n\n") + lua_tostring(State, -1);
+		lua_settop(State, 0);
+		throw Error;
+	}
+	lua_settop(State, 0);
+}
+
+//-- Batch mode
+// Jobs are read from stdin, one per line: a script path followed by its arguments, separated by whitespace.  Each
+// worker thread owns a prepared Lua state and a job queue; idle workers steal from the back of other queues.
+struct Job
+{
+	unsigned int Number;
+	std::string Script;
+	std::vector<std::string> Arguments;
+};
+
+struct JobQueue
+{
+	std::mutex Mutex;
+	std::deque<Job> Jobs;
+};
+
+class WorkerPool
+{
+	public:
+		WorkerPool(unsigned int WorkerCount, ScriptCache &Cache) : Cache(Cache), Queues(WorkerCount), NextQueue(0), Pending(0), Closed(false), Failures(0)
+		{
+			for (auto &Queue : Queues) Queue.reset(new JobQueue);
+			for (unsigned int Index = 0; Index < WorkerCount; ++Index)
+				Workers.emplace_back(&WorkerPool::Work, this, Index);
+		}
+
+		void Add(Job &&NewJob)
+		{
+			JobQueue &Queue = *Queues[NextQueue++ % Queues.size()];
+			{
+				std::lock_guard<std::mutex> Lock(Queue.Mutex);
+				Queue.Jobs.push_back(std::move(NewJob));
+			}
+			{
+				std::lock_guard<std::mutex> Lock(WaitMutex);
+				++Pending;
+			}
+			Wake.notify_one();
+		}
+
+		// Waits for all queued jobs, returns the number that failed
+		unsigned int Finish(void)
+		{
+			{
+				std::lock_guard<std::mutex> Lock(WaitMutex);
+				Closed = true;
+			}
+			Wake.notify_all();
+			for (auto &Worker : Workers) Worker.join();
+			return Failures;
+		}
+
+	private:
+		bool Take(unsigned int Index, Job &Out)
+		{
+			for (unsigned int Offset = 0; Offset < Queues.size(); ++Offset)
+			{
+				JobQueue &Queue = *Queues[(Index + Offset) % Queues.size()];
+				std::lock_guard<std::mutex> Lock(Queue.Mutex);
+				if (Queue.Jobs.empty()) continue;
+				if (Offset == 0)
+				{
+					Out = std::move(Queue.Jobs.front());
+					Queue.Jobs.pop_front();
+				}
+				else
+				{
+					Out = std::move(Queue.Jobs.back());
+					Queue.Jobs.pop_back();
+				}
+				return true;
+			}
+			return false;
+		}
+
+		void Report(std::string const &Line)
+		{
+			std::lock_guard<std::mutex> Lock(OutputMutex);
+			std::cout << Line << std::endl;
+		}
+
+		void Work(unsigned int Index)
+		{
+			lua_State *State = nullptr;
+			try { State = CreateState(); }
+			catch (std::string &Error) { Report("worker " + std::to_string(Index) + " error " + Error); }
+
+			while (true)
+			{
+				{
+					std::unique_lock<std::mutex> Lock(WaitMutex);
+					Wake.wait(Lock, [this](void) { return (Pending > 0) || Closed; });
+					if (Pending == 0) break;
+					--Pending;
+				}
+
+				Job Current;
+				bool Found = Take(Index, Current);
+				assert(Found);
+				if (!Found) continue;
+
+				try
+				{
+					if (State == nullptr) throw std::string("No Lua state.");
+					RunScript(State, &Cache, Current.Script, Current.Arguments, true);
+					lua_gc(State, LUA_GCCOLLECT, 0);
+					Report(std::to_string(Current.Number) + " ok");
+				}
+				catch (std::string &Error)
+				{
+					++Failures;
+					for (auto &Character : Error) if (Character == '\n') Character = ' ';
+					Report(std::to_string(Current.Number) + " error " + Error);
+				}
+			}
+			if (State != nullptr) lua_close(State);
+		}
+
+		ScriptCache &Cache;
+		std::vector<std::unique_ptr<JobQueue> > Queues;
+		std::vector<std::thread> Workers;
+		unsigned int NextQueue;
+
+		std::mutex WaitMutex;
+		std::condition_variable Wake;
+		unsigned int Pending;
+		bool Closed;
+
+		std::mutex OutputMutex;
+		std::atomic<unsigned int> Failures;
+};
+
+int RunBatch(unsigned int WorkerCount, ScriptCache &Cache)
+{
+	WorkerPool Pool(WorkerCount, Cache);
+	std::string Line;
+	unsigned int Number = 0;
+	while (std::getline(std::cin, Line))
+	{
+		Job NewJob;
+		NewJob.Number = ++Number;
+		std::istringstream Words(Line);
+		if (!(Words >> NewJob.Script) || (NewJob.Script[0] == '#')) continue;
+		std::string Argument;
+		while (Words >> Argument) NewJob.Arguments.push_back(Argument);
+		Pool.Add(std::move(NewJob));
+	}
+	return Pool.Finish() == 0 ? 0 : 1;
+}
+
+int main(int ArgumentCount, char **Arguments)
+{
+	// luacairo [--cache-dir directory] (script [arguments...] | --workers [count])
+	int Next = 1;
+	std::string CacheDirectory;
+	bool Batch = false;
+	unsigned int WorkerCount = std::thread::hardware_concurrency();
+	while ((Next < ArgumentCount) && (strncmp(Arguments[Next], "--", 2) == 0))
+	{
+		if ((strcmp(Arguments[Next], "--cache-dir") == 0) && (Next + 1 < ArgumentCount))
+		{
+			CacheDirectory = Arguments[Next + 1];
+			Next += 2;
+		}
+		else if (strcmp(Arguments[Next], "--workers") == 0)
+		{
+			Batch = true;
+			Next += 1;
+			if ((Next < ArgumentCount) && isdigit(Arguments[Next][0]))
+				WorkerCount = strtoul(Arguments[Next++], nullptr, 10);
+		}
+		else
 		{
-			lua_pushstring(State, Arguments[CurrentArgument]);
-			lua_rawseti(State, -2, CurrentArgument + 1);
+			std::cerr << "Fatal Error: Unknown option " << Arguments[Next] << std::endl;
+			return 1;
 		}
-		lua_setglobal(State, "arg");
-#ifndef NDEBUG
-		assert((unsigned int)lua_gettop(State) == InitialHeight);
-#endif
-
-		// Load and run script
-		assert(lua_gettop(State) == 0);
-		lua_getglobal(State, "debug");
-		lua_getfield(State, -1, "traceback");
-		lua_remove(State, -2);
-
-		int LoadError = luaL_loadfile(State, Arguments[1]);
-		if (LoadError != LUA_OK)
-			throw std::string("Unable to open script file; Error was:\n\n") + lua_tostring(State, -1);
-
-		assert(lua_isfunction(State, 1));
-		int Result = lua_pcall(State, 0, 0, 1);
-		if (Result != LUA_OK)
-			throw std::string("Error while running script; Error was:\n\n") + lua_tostring(State, -1);
+	}
+
+	if (Batch)
+	{
+		ScriptCache Cache(CacheDirectory);
+		return RunBatch(WorkerCount == 0 ? 1 : WorkerCount, Cache);
+	}
+
+	lua_State *State = nullptr;
+	try
+	{
+		if (Next >= ArgumentCount)
+			throw std::string("You must specify a Lua script as the first argument, or --workers [count] to read jobs from stdin.");
+
+		State = CreateState();
+		std::unique_ptr<ScriptCache> Cache;
+		if (!CacheDirectory.empty()) Cache.reset(new ScriptCache(CacheDirectory));
+		RunScript(State, Cache.get(), Arguments[Next], std::vector<std::string>(Arguments + Next + 1, Arguments + ArgumentCount), false);
 	}
 	catch (std::string &Error)
 	{
 		std::cerr << "Fatal Error: " << Error << std::endl;
-		lua_close(State);
+		if (State != nullptr) lua_close(State);
 		return 1;
 	}
 	lua_close(State);
 	return 0;
 }
-
@@ -0,0 +1,134 @@
+#ifndef surfacepool_h
+#define surfacepool_h
+
+#include <cstring>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "cache.h"
+
+// Surface pool
+// cairo.pooledimagesurface(format, width, height) hands out a cleared image surface, reusing one returned to the pool
+// if there is one of the same format and size.  surface:release() (or collection) returns a pooled surface to the pool
+// as long as nothing else (a context, a pattern) still references it; otherwise, and for surfaces that aren't pooled,
+// it just drops the reference.  Released objects can't be used again.  At most a limited number of surfaces of each
+// format and size are kept (cairo.setsurfacepoollimit).
+class SurfacePool
+{
+	public:
+		SurfacePool(size_t Limit) : Limit(Limit) {}
+		~SurfacePool(void) { Clear(); }
+
+		SurfacePool(SurfacePool const &) = delete;
+		SurfacePool &operator =(SurfacePool const &) = delete;
+
+		// Returns a pooled surface (with its reference) or nullptr
+		cairo_surface_t *Take(cairo_format_t Format, int Width, int Height)
+		{
+			auto Found = Surfaces.find(Key(Format, Width, Height));
+			if ((Found == Surfaces.end()) || Found->second.empty()) return nullptr;
+			cairo_surface_t *Surface = Found->second.back();
+			Found->second.pop_back();
+			return Surface;
+		}
+
+		// Takes over the reference if there is room
+		bool Give(cairo_surface_t *Surface)
+		{
+			std::vector<cairo_surface_t *> &Free = Surfaces[Key(
+				cairo_image_surface_get_format(Surface), cairo_image_surface_get_width(Surface), cairo_image_surface_get_height(Surface))];
+			if (Free.size() >= Limit) return false;
+			Free.push_back(Surface);
+			return true;
+		}
+
+		void SetLimit(size_t NewLimit)
+		{
+			Limit = NewLimit;
+			for (auto &Free : Surfaces)
+				while (Free.second.size() > Limit)
+				{
+					cairo_surface_destroy(Free.second.back());
+					Free.second.pop_back();
+				}
+		}
+
+		void Clear(void)
+		{
+			for (auto &Free : Surfaces)
+				for (auto Surface : Free.second) cairo_surface_destroy(Surface);
+			Surfaces.clear();
+		}
+
+	private:
+		typedef std::tuple<int, int, int> Key;
+		std::map<Key, std::vector<cairo_surface_t *> > Surfaces;
+		size_t Limit;
+};
+
+static UIDObject SurfacePoolKey;
+static cairo_user_data_key_t PooledSurfaceKey;
+size_t const DefaultSurfacePoolLimit = 4;
+
+inline SurfacePool *GetSurfacePool(lua_State *State)
+	{ return GetStateObject<SurfacePool>(State, SurfacePoolKey, DefaultSurfacePoolLimit); }
+
+static int CreatePooledImageSurface(lua_State *State)
+{
+	cairo_format_t Format = LuaValue<cairo_format_t>::Read(State, 1);
+	int Width = LuaValue<int>::Read(State, 2);
+	int Height = LuaValue<int>::Read(State, 3);
+
+	// The pool is created before the surface object so the surface is finalized first when both go at once
+	SurfacePool *Pool = GetSurfacePool(State);
+	cairo_surface_t *Surface = Pool->Take(Format, Width, Height);
+	if (Surface != nullptr)
+	{
+		cairo_surface_flush(Surface);
+		memset(cairo_image_surface_get_data(Surface), 0, (size_t)cairo_image_surface_get_stride(Surface) * Height);
+		cairo_surface_mark_dirty(Surface);
+		cairo_surface_set_device_offset(Surface, 0, 0);
+	}
+	else
+	{
+		Surface = cairo_image_surface_create(Format, Width, Height);
+		if (cairo_surface_status(Surface) == CAIRO_STATUS_SUCCESS)
+			cairo_surface_set_user_data(Surface, &PooledSurfaceKey, Pool, nullptr);
+	}
+	LuaValue<cairo_surface_t *>::Write(State, lua_upvalueindex(1), Surface);
+	return 1;
+}
+
+// surface:release(), also the finalizer for all surface objects
+static int ReleaseSurface(lua_State *State)
+{
+	if (!IsObjectOfType(State, 1, TagOf(cairo_surface_t))) ArgumentError(State, 1, typeid(cairo_surface_t *).name());
+	ObjectHeader *Header = static_cast<ObjectHeader *>(lua_touserdata(State, 1));
+	cairo_surface_t *Surface = static_cast<cairo_surface_t *>(Header->Data);
+	if (Surface == nullptr) return 0;
+	Header->Data = nullptr;
+
+	if ((cairo_surface_get_user_data(Surface, &PooledSurfaceKey) != nullptr) &&
+		(cairo_surface_get_reference_count(Surface) == 1) &&
+		GetSurfacePool(State)->Give(Surface))
+		return 0;
+	cairo_surface_destroy(Surface);
+	return 0;
+}
+
+static int SetSurfacePoolLimit(lua_State *State)
+{
+	lua_Integer Limit = luaL_checkinteger(State, 1);
+	if (Limit < 0) return luaL_error(State, "Surface pool limit must not be negative.");
+	GetSurfacePool(State)->SetLimit(Limit);
+	return 0;
+}
+
+static int ClearSurfacePool(lua_State *State)
+{
+	GetSurfacePool(State)->Clear();
+	return 0;
+}
+
+#endif
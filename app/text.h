@@ -0,0 +1,298 @@
+#ifndef text_h
+#define text_h
+
+#include <mutex>
+#include <string>
+
+#include "cache.h"
+
+// Glyph arrays
+// Glyphs are packed arrays of cairo_glyph_t: strings as texttoglyphs returns them, or flat index, x, y sequences.
+template <> struct PackedElement<cairo_glyph_t>
+{
+	static constexpr int Fields = 3;
+	static void Set(cairo_glyph_t &Out, double const *Values)
+	{
+		Out.index = (unsigned long)Values[0];
+		Out.x = Values[1];
+		Out.y = Values[2];
+	}
+};
+
+static int ShowGlyphs(lua_State *State)
+{
+	cairo_t *Context = LuaValue<cairo_t *>::Read(State, 1);
+	PackedArray<cairo_glyph_t> Glyphs(State, 2);
+	cairo_show_glyphs(Context, Glyphs.Data, (int)Glyphs.Count);
+	return 0;
+}
+
+static int GlyphPath(lua_State *State)
+{
+	cairo_t *Context = LuaValue<cairo_t *>::Read(State, 1);
+	PackedArray<cairo_glyph_t> Glyphs(State, 2);
+	cairo_glyph_path(Context, Glyphs.Data, (int)Glyphs.Count);
+	return 0;
+}
+
+// Glyph run cache
+// Each scaled font keeps the glyphs cairo_scaled_font_text_to_glyphs produced for the strings it was asked to lay out,
+// positioned from 0, 0, along with where the next glyph would go and their extents.  It lives as long as the scaled
+// font; cairo keeps recently used scaled fonts around, so labels drawn every frame with the same font and
+// transformation stay cached.  Cairo shares scaled fonts between threads, so the cache is locked and runs are copied
+// out of it.
+struct GlyphRun
+{
+	std::string Glyphs; // Packed cairo_glyph_t
+	double AdvanceX, AdvanceY;
+	cairo_text_extents_t Extents;
+};
+
+inline void DestroyGlyphRun(GlyphRun &) {}
+
+size_t const GlyphRunCacheBudget = 256 << 10;
+
+struct GlyphRunCache
+{
+	GlyphRunCache(void) : Runs(GlyphRunCacheBudget, &DestroyGlyphRun) {}
+
+	std::mutex Lock;
+	LRUCache<std::string, GlyphRun> Runs;
+};
+
+static cairo_user_data_key_t GlyphRunCacheKey;
+static std::mutex GlyphRunCacheCreation; // Cairo doesn't lock font user data
+
+inline void DestroyGlyphRunCache(void *Cache) { delete static_cast<GlyphRunCache *>(Cache); }
+
+// Copies the run for Text into Run, or only its advance and extents if ExtentsOnly is set
+inline cairo_status_t FindGlyphRun(cairo_scaled_font_t *Font, char const *Text, size_t Length, GlyphRun &Run, bool ExtentsOnly = false)
+{
+	cairo_status_t Status = cairo_scaled_font_status(Font);
+	if (Status != CAIRO_STATUS_SUCCESS) return Status;
+	GlyphRunCache *Cache;
+	{
+		std::lock_guard<std::mutex> Guard(GlyphRunCacheCreation);
+		Cache = static_cast<GlyphRunCache *>(cairo_scaled_font_get_user_data(Font, &GlyphRunCacheKey));
+		if (Cache == nullptr)
+		{
+			Cache = new GlyphRunCache;
+			Status = cairo_scaled_font_set_user_data(Font, &GlyphRunCacheKey, Cache, &DestroyGlyphRunCache);
+			if (Status != CAIRO_STATUS_SUCCESS)
+			{
+				delete Cache;
+				return Status;
+			}
+		}
+	}
+
+	std::string const Key(Text, Length);
+	{
+		std::lock_guard<std::mutex> Guard(Cache->Lock);
+		GlyphRun const *Found = Cache->Runs.Find(Key);
+		if (Found != nullptr)
+		{
+			if (!ExtentsOnly) Run.Glyphs = Found->Glyphs;
+			Run.AdvanceX = Found->AdvanceX;
+			Run.AdvanceY = Found->AdvanceY;
+			Run.Extents = Found->Extents;
+			return CAIRO_STATUS_SUCCESS;
+		}
+	}
+
+	cairo_glyph_t *Glyphs = nullptr;
+	int Count = 0;
+	Status = cairo_scaled_font_text_to_glyphs(Font, 0, 0, Text, (int)Length, &Glyphs, &Count, nullptr, nullptr, nullptr);
+	if (Status != CAIRO_STATUS_SUCCESS) return Status;
+	GlyphRun Created = {std::string(reinterpret_cast<char const *>(Glyphs), Count * sizeof(cairo_glyph_t)), 0, 0, {0, 0, 0, 0, 0, 0}};
+	if (Count > 0)
+	{
+		cairo_scaled_font_glyph_extents(Font, Glyphs, Count, &Created.Extents);
+
+		// Where cairo_show_text would leave the current point
+		cairo_text_extents_t Extents;
+		cairo_scaled_font_glyph_extents(Font, Glyphs + Count - 1, 1, &Extents);
+		Created.AdvanceX = Glyphs[Count - 1].x + Extents.x_advance;
+		Created.AdvanceY = Glyphs[Count - 1].y + Extents.y_advance;
+	}
+	cairo_glyph_free(Glyphs);
+	Run = Created;
+	std::lock_guard<std::mutex> Guard(Cache->Lock);
+	Cache->Runs.Insert(Key, Created, Key.size() + Created.Glyphs.size() + sizeof(GlyphRun));
+	return CAIRO_STATUS_SUCCESS;
+}
+
+// context:showtext(text) is cairo_show_text with the layout taken from the glyph run cache
+static int ShowText(lua_State *State)
+{
+	cairo_t *Context = LuaValue<cairo_t *>::Read(State, 1);
+	size_t Length;
+	char const *Text = luaL_checklstring(State, 2, &Length);
+	if (Length == 0) return 0;
+
+	cairo_status_t Status;
+	{
+		GlyphRun Run;
+		Status = FindGlyphRun(cairo_get_scaled_font(Context), Text, Length, Run);
+		if (Status == CAIRO_STATUS_SUCCESS)
+		{
+			// The run is drawn from the current point by moving user space there rather than offsetting it
+			double X = 0, Y = 0;
+			if (cairo_has_current_point(Context)) cairo_get_current_point(Context, &X, &Y);
+			cairo_matrix_t Matrix;
+			cairo_get_matrix(Context, &Matrix);
+			cairo_translate(Context, X, Y);
+			cairo_show_glyphs(Context, reinterpret_cast<cairo_glyph_t const *>(Run.Glyphs.data()), (int)(Run.Glyphs.size() / sizeof(cairo_glyph_t)));
+			cairo_set_matrix(Context, &Matrix);
+			cairo_move_to(Context, X + Run.AdvanceX, Y + Run.AdvanceY);
+		}
+	}
+	if (Status != CAIRO_STATUS_SUCCESS) return luaL_error(State, "Laying out the text failed: %s", cairo_status_to_string(Status));
+	return 0;
+}
+
+// scaledfont:texttoglyphs(text[, x, y]) returns the packed glyphs for text starting at x, y and the point after them
+static int ScaledFontTextToGlyphs(lua_State *State)
+{
+	cairo_scaled_font_t *Font = LuaValue<cairo_scaled_font_t *>::Read(State, 1);
+	size_t Length;
+	char const *Text = luaL_checklstring(State, 2, &Length);
+	double const X = lua_isnoneornil(State, 3) ? 0 : LuaValue<double>::Read(State, 3);
+	double const Y = lua_isnoneornil(State, 4) ? 0 : LuaValue<double>::Read(State, 4);
+
+	cairo_status_t Status;
+	{
+		GlyphRun Run;
+		Status = FindGlyphRun(Font, Text, Length, Run);
+		if (Status == CAIRO_STATUS_SUCCESS)
+		{
+			size_t const Count = Run.Glyphs.size() / sizeof(cairo_glyph_t);
+			cairo_glyph_t *Glyphs = reinterpret_cast<cairo_glyph_t *>(&Run.Glyphs[0]);
+			for (size_t Index = 0; Index < Count; ++Index)
+			{
+				Glyphs[Index].x += X;
+				Glyphs[Index].y += Y;
+			}
+			lua_pushlstring(State, Run.Glyphs.data(), Run.Glyphs.size());
+			lua_pushnumber(State, X + Run.AdvanceX);
+			lua_pushnumber(State, Y + Run.AdvanceY);
+		}
+	}
+	if (Status != CAIRO_STATUS_SUCCESS) return luaL_error(State, "Laying out the text failed: %s", cairo_status_to_string(Status));
+	return 3;
+}
+
+// Text and font extents
+// textextents(text) returns x bearing, y bearing, width, height, x advance and y advance, as cairo_text_extents does,
+// from the glyph run cache.  fontextents() returns ascent, descent, height, max x advance and max y advance.
+// context:measuretexts(texts) measures a sequence of strings at once and returns a buffer of their text extents, six
+// values per string.
+inline cairo_text_extents_t FindTextExtents(lua_State *State, cairo_scaled_font_t *Font, int Position)
+{
+	size_t Length;
+	char const *Text = lua_tolstring(State, Position, &Length);
+	if (Text == nullptr) ArgumentError(State, Position, "string");
+	cairo_status_t Status;
+	cairo_text_extents_t Extents;
+	{
+		GlyphRun Run = GlyphRun();
+		Status = FindGlyphRun(Font, Text, Length, Run, true);
+		Extents = Run.Extents;
+	}
+	if (Status != CAIRO_STATUS_SUCCESS) luaL_error(State, "Measuring the text failed: %s", cairo_status_to_string(Status));
+	return Extents;
+}
+
+inline int PushTextExtents(lua_State *State, cairo_text_extents_t const &Extents)
+{
+	lua_pushnumber(State, Extents.x_bearing);
+	lua_pushnumber(State, Extents.y_bearing);
+	lua_pushnumber(State, Extents.width);
+	lua_pushnumber(State, Extents.height);
+	lua_pushnumber(State, Extents.x_advance);
+	lua_pushnumber(State, Extents.y_advance);
+	return 6;
+}
+
+inline int PushFontExtents(lua_State *State, cairo_font_extents_t const &Extents)
+{
+	lua_pushnumber(State, Extents.ascent);
+	lua_pushnumber(State, Extents.descent);
+	lua_pushnumber(State, Extents.height);
+	lua_pushnumber(State, Extents.max_x_advance);
+	lua_pushnumber(State, Extents.max_y_advance);
+	return 5;
+}
+
+static int GetTextExtents(lua_State *State)
+{
+	cairo_t *Context = LuaValue<cairo_t *>::Read(State, 1);
+	return PushTextExtents(State, FindTextExtents(State, cairo_get_scaled_font(Context), 2));
+}
+
+static int GetFontExtents(lua_State *State)
+{
+	cairo_font_extents_t Extents;
+	cairo_font_extents(LuaValue<cairo_t *>::Read(State, 1), &Extents);
+	return PushFontExtents(State, Extents);
+}
+
+static int GetScaledFontTextExtents(lua_State *State)
+{
+	cairo_scaled_font_t *Font = LuaValue<cairo_scaled_font_t *>::Read(State, 1);
+	return PushTextExtents(State, FindTextExtents(State, Font, 2));
+}
+
+static int GetScaledFontExtents(lua_State *State)
+{
+	cairo_font_extents_t Extents;
+	cairo_scaled_font_extents(LuaValue<cairo_scaled_font_t *>::Read(State, 1), &Extents);
+	return PushFontExtents(State, Extents);
+}
+
+static int MeasureTexts(lua_State *State)
+{
+	cairo_t *Context = LuaValue<cairo_t *>::Read(State, 1);
+	luaL_checktype(State, 2, LUA_TTABLE);
+	size_t const Count = lua_rawlen(State, 2);
+	cairo_scaled_font_t *Font = cairo_get_scaled_font(Context);
+	double *Next = PushDoubleBuffer(State, lua_upvalueindex(1), Count * 6)->Data;
+	for (size_t Index = 0; Index < Count; ++Index, Next += 6)
+	{
+		lua_rawgeti(State, 2, Index + 1);
+		if (lua_type(State, -1) != LUA_TSTRING)
+			return luaL_error(State, "Element %d of parameter 2 must be a string, but it is a \"%s\".", (int)Index + 1, lua_typename(State, lua_type(State, -1)));
+		cairo_text_extents_t const Extents = FindTextExtents(State, Font, -1);
+		Next[0] = Extents.x_bearing;
+		Next[1] = Extents.y_bearing;
+		Next[2] = Extents.width;
+		Next[3] = Extents.height;
+		Next[4] = Extents.x_advance;
+		Next[5] = Extents.y_advance;
+		lua_pop(State, 1);
+	}
+	return 1;
+}
+
+// cairo.scaledfont(face, size or fontmatrix[, ctm]) with default font options
+static int CreateScaledFont(lua_State *State)
+{
+	cairo_font_face_t *Face = LuaValue<cairo_font_face_t *>::Read(State, 1);
+	cairo_matrix_t FontMatrix, Transformation;
+	if (lua_type(State, 2) == LUA_TNUMBER)
+	{
+		double const Size = lua_tonumber(State, 2);
+		cairo_matrix_init_scale(&FontMatrix, Size, Size);
+	}
+	else FontMatrix = *LuaValue<cairo_matrix_t *>::Read(State, 2);
+	if (lua_isnoneornil(State, 3)) cairo_matrix_init_identity(&Transformation);
+	else Transformation = *LuaValue<cairo_matrix_t *>::Read(State, 3);
+
+	cairo_font_options_t *Options = cairo_font_options_create();
+	cairo_scaled_font_t *Font = cairo_scaled_font_create(Face, &FontMatrix, &Transformation, Options);
+	cairo_font_options_destroy(Options);
+	LuaValue<cairo_scaled_font_t *>::Write(State, lua_upvalueindex(1), Font);
+	return 1;
+}
+
+#endif
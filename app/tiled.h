@@ -0,0 +1,220 @@
+#ifndef tiled_h
+#define tiled_h
+
+#include <algorithm>
+#include <atomic>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "library.h"
+
+// Parallel replay
+// surface:replayparallel(source | draw[, threads[, tileheight]]) paints onto an image surface in horizontal bands,
+// one band at a time per thread.  Each band is drawn through its own image surface over the shared pixel memory, so
+// threads never share a cairo_t or target surface.  Cairo changes a source surface while painting it (reference
+// counts, snapshots), so no source object is shared either:
+// - An image source is read by each thread through an image surface of its own over the source's pixels, which are
+//   never copied.
+// - Anything else is drawn by the function draw, called once per thread on the calling thread with a context for
+//   that thread's own recording surface.  What it draws must be self-contained: a recording that used another surface
+//   as a source or mask would share that surface between threads, so it is refused.
+
+// Recording surfaces that are drawn with another surface as the source or mask are marked as depending on it
+static cairo_user_data_key_t SurfaceSourceKey;
+
+inline void NoteSurfaceSource(cairo_t *Context, cairo_pattern_t *Pattern)
+{
+	if (cairo_pattern_get_type(Pattern) != CAIRO_PATTERN_TYPE_SURFACE) return;
+	cairo_surface_t *Target = cairo_get_group_target(Context);
+	if (cairo_surface_get_type(Target) == CAIRO_SURFACE_TYPE_RECORDING)
+		cairo_surface_set_user_data(Target, &SurfaceSourceKey, Target, nullptr);
+}
+
+inline bool HasSurfaceSource(cairo_surface_t *Surface)
+	{ return cairo_surface_get_user_data(Surface, &SurfaceSourceKey) != nullptr; }
+
+// Context methods that can draw a surface, registered in place of the plain cairo functions
+inline void SetSource(cairo_t *Context, cairo_pattern_t *Source)
+{
+	cairo_set_source(Context, Source);
+	NoteSurfaceSource(Context, Source);
+}
+
+inline void SetSourceSurface(cairo_t *Context, cairo_surface_t *Surface, double X, double Y)
+{
+	cairo_set_source_surface(Context, Surface, X, Y);
+	NoteSurfaceSource(Context, cairo_get_source(Context));
+}
+
+inline void PopGroupToSource(cairo_t *Context)
+{
+	cairo_pop_group_to_source(Context);
+	NoteSurfaceSource(Context, cairo_get_source(Context));
+}
+
+inline void Mask(cairo_t *Context, cairo_pattern_t *Pattern)
+{
+	NoteSurfaceSource(Context, Pattern);
+	cairo_mask(Context, Pattern);
+}
+
+inline void MaskSurface(cairo_t *Context, cairo_surface_t *Surface, double X, double Y)
+{
+	cairo_pattern_t *Pattern = cairo_pattern_create_for_surface(Surface);
+	NoteSurfaceSource(Context, Pattern);
+	cairo_pattern_destroy(Pattern);
+	cairo_mask_surface(Context, Surface, X, Y);
+}
+
+struct ReplayImage
+{
+	unsigned char *Data;
+	cairo_format_t Format;
+	int Width;
+	int Height;
+	int Stride;
+};
+
+inline ReplayImage GetReplayImage(cairo_surface_t *Surface)
+{
+	ReplayImage Image = {cairo_image_surface_get_data(Surface), cairo_image_surface_get_format(Surface),
+		cairo_image_surface_get_width(Surface), cairo_image_surface_get_height(Surface), cairo_image_surface_get_stride(Surface)};
+	return Image;
+}
+
+struct TiledReplay
+{
+	ReplayImage Target;
+	ReplayImage Source; // Data is null if each thread has a recording instead
+	double SourceX, SourceY; // Device offset of the source image
+	int TileHeight;
+	std::atomic<int> NextTile;
+	std::atomic<int> Status;
+};
+
+inline void ReplayTiles(TiledReplay *Replay, cairo_surface_t *Source)
+{
+	if (Source == nullptr)
+	{
+		ReplayImage const &Image = Replay->Source;
+		Source = cairo_image_surface_create_for_data(Image.Data, Image.Format, Image.Width, Image.Height, Image.Stride);
+		cairo_surface_set_device_offset(Source, Replay->SourceX, Replay->SourceY);
+	}
+	else cairo_surface_reference(Source);
+
+	while (cairo_surface_status(Source) == CAIRO_STATUS_SUCCESS)
+	{
+		int Top = Replay->NextTile++ * Replay->TileHeight;
+		if (Top >= Replay->Target.Height) break;
+		int Rows = std::min(Replay->TileHeight, Replay->Target.Height - Top);
+
+		ReplayImage const &Target = Replay->Target;
+		cairo_surface_t *Tile = cairo_image_surface_create_for_data(
+			Target.Data + (size_t)Top * Target.Stride, Target.Format, Target.Width, Rows, Target.Stride);
+		cairo_t *Context = cairo_create(Tile);
+		cairo_set_source_surface(Context, Source, 0, -Top);
+		cairo_paint(Context);
+		cairo_status_t Status = cairo_status(Context);
+		if (Status != CAIRO_STATUS_SUCCESS) Replay->Status = Status;
+		cairo_destroy(Context);
+		cairo_surface_destroy(Tile);
+	}
+	if (cairo_surface_status(Source) != CAIRO_STATUS_SUCCESS) Replay->Status = cairo_surface_status(Source);
+	cairo_surface_destroy(Source);
+}
+
+inline void DestroyReplaySources(std::vector<cairo_surface_t *> &Sources)
+{
+	for (auto Source : Sources) cairo_surface_destroy(Source);
+	Sources.clear();
+}
+
+static int ReplayParallel(lua_State *State)
+{
+	cairo_surface_t *Target = LuaValue<cairo_surface_t *>::Read(State, 1);
+	bool const Drawn = lua_isfunction(State, 2);
+	cairo_surface_t *Source = Drawn ? nullptr : LuaValue<cairo_surface_t *>::Read(State, 2);
+	lua_Integer ThreadCount = luaL_optinteger(State, 3, std::max(1u, std::thread::hardware_concurrency()));
+	if (ThreadCount < 1) return luaL_error(State, "Parameter 3 must be at least 1.");
+	if (cairo_surface_get_type(Target) != CAIRO_SURFACE_TYPE_IMAGE)
+		return luaL_error(State, "Parallel replay requires an image surface target.");
+	if (Source == Target) return luaL_error(State, "Parallel replay can't read from its target.");
+	if (!Drawn && (cairo_surface_get_type(Source) != CAIRO_SURFACE_TYPE_IMAGE))
+		return luaL_error(State, "Parallel replay needs an image surface or a function that draws the content.");
+
+	TiledReplay Replay;
+	Replay.Target = GetReplayImage(Target);
+	Replay.Source.Data = nullptr;
+	Replay.SourceX = Replay.SourceY = 0;
+	// Several bands per thread by default so uneven content still balances
+	Replay.TileHeight = luaL_optinteger(State, 4,
+		std::max<lua_Integer>(1, (Replay.Target.Height + ThreadCount * 4 - 1) / (ThreadCount * 4)));
+	Replay.NextTile = 0;
+	Replay.Status = CAIRO_STATUS_SUCCESS;
+	if (Replay.TileHeight < 1) return luaL_error(State, "Parameter 4 must be at least 1.");
+	if ((Replay.Target.Data == nullptr) || (Replay.Target.Height == 0)) return 0;
+	int const TileCount = (Replay.Target.Height + Replay.TileHeight - 1) / Replay.TileHeight;
+	size_t const WorkerCount = (size_t)std::min<lua_Integer>(ThreadCount, TileCount);
+
+	std::vector<cairo_surface_t *> Sources;
+	if (!Drawn)
+	{
+		cairo_surface_flush(Source);
+		Replay.Source = GetReplayImage(Source);
+		if (Replay.Source.Data == nullptr) return luaL_error(State, "Surface has no image data.");
+		cairo_surface_get_device_offset(Source, &Replay.SourceX, &Replay.SourceY);
+		Sources.resize(WorkerCount, nullptr);
+	}
+	else
+	{
+#ifdef CAIRO_HAS_RECORDING_SURFACE
+		cairo_rectangle_t const Extents = {0, 0, (double)Replay.Target.Width, (double)Replay.Target.Height};
+		while (Sources.size() < WorkerCount)
+		{
+			cairo_surface_t *Recording = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, &Extents);
+			Sources.push_back(Recording);
+
+			// The context belongs to Lua from here on
+			lua_pushvalue(State, 2);
+			PushMetatable(State, AsUID(cairo_create));
+			LuaValue<cairo_t *>::Write(State, lua_gettop(State), cairo_create(Recording));
+			lua_remove(State, -2);
+			if (lua_pcall(State, 1, 0, 0) != LUA_OK)
+			{
+				DestroyReplaySources(Sources);
+				return lua_error(State);
+			}
+			cairo_surface_flush(Recording);
+			if (HasSurfaceSource(Recording))
+			{
+				DestroyReplaySources(Sources);
+				return luaL_error(State, "Parallel replay can't draw other surfaces, since every thread would share them.");
+			}
+		}
+#else
+		return luaL_error(State, "Recording surfaces aren't available, parallel replay needs an image surface.");
+#endif
+	}
+
+	cairo_surface_flush(Target);
+	{
+		std::vector<std::thread> Threads;
+		try
+		{
+			for (size_t Index = 1; Index < Sources.size(); ++Index)
+				Threads.emplace_back(ReplayTiles, &Replay, Sources[Index]);
+		}
+		catch (std::system_error &) {} // Render with however many threads could be started
+		ReplayTiles(&Replay, Sources[0]);
+		for (auto &Thread : Threads) Thread.join();
+	}
+	cairo_surface_mark_dirty(Target);
+	DestroyReplaySources(Sources);
+
+	if (Replay.Status != CAIRO_STATUS_SUCCESS)
+		return luaL_error(State, "Parallel replay failed: %s", cairo_status_to_string((cairo_status_t)(int)Replay.Status));
+	return 0;
+}
+
+#endif
@@ -0,0 +1,77 @@
+-- Per-call binding overhead and object lifecycle costs.
+-- Run with: build/luacairo bench/binding.lua [iterations]
+
+package.path = (arg[0]:match('(.*/)') or './') .. '?.lua;' .. package.path
+local common = require 'common'
+require 'cairo'
+
+local iterations = tonumber(arg[1]) or 1000000
+
+local surface = cairo.imagesurface(cairo.format.ARGB32, 64, 64)
+local context = cairo.context(surface)
+local matrix = cairo.identitymatrix()
+
+-- Wrapper overhead
+common.measure('call.single.lineto', iterations, function() context:lineto(1, 2) end)
+context:newpath()
+common.measure('call.single.curveto', iterations, function() context:curveto(1, 2, 3, 4, 5, 6) end)
+context:newpath()
+common.measure('call.single.getlinewidth', iterations, function() return context:getlinewidth() end)
+context:rectangle(0, 0, 32, 32)
+common.measure('call.multiple.pathextents', iterations, function() return context:pathextents() end)
+context:newpath()
+common.measure('call.multiple.getdeviceoffset', iterations, function() return surface:getdeviceoffset() end)
+common.measure('call.inputoutput.transformpoint', iterations, function() return matrix:transformpoint(3, 4) end)
+
+-- Object creation, including collection
+common.measure('object.identitymatrix', iterations, function() return cairo.identitymatrix() end, true)
+common.measure('object.rgbpattern', iterations, function() return cairo.rgbpattern(1, 0, 0) end, true)
+common.measure('object.getsource', iterations, function() return context:getsource() end, true)
+common.measure('object.gettarget', iterations, function() return context:gettarget() end, true)
+common.measure('object.imagesurface', math.ceil(iterations / 100), function() return cairo.imagesurface(cairo.format.ARGB32, 64, 64) end, true)
+common.measure('object.pooledimagesurface', math.ceil(iterations / 100), function() cairo.pooledimagesurface(cairo.format.ARGB32, 64, 64):release() end, true)
+
+-- Building a path in Lua against appending a cached one
+local function roundedrectangle(context, width, height, radius)
+	context:newsubpath()
+	context:arc(width - radius, radius, radius, -math.pi / 2, 0)
+	context:arc(width - radius, height - radius, radius, 0, math.pi / 2)
+	context:arc(radius, height - radius, radius, math.pi / 2, math.pi)
+	context:arc(radius, radius, radius, math.pi, 3 * math.pi / 2)
+	context:closepath()
+end
+cairo.defineshape('roundedrectangle', roundedrectangle)
+common.measure('path.roundedrectangle.lua', iterations, function() context:newpath() context:translate(8, 8) roundedrectangle(context, 32, 16, 4) context:translate(-8, -8) end)
+common.measure('path.roundedrectangle.cached', iterations, function() context:newpath() context:drawcached('roundedrectangle', 8, 8, 32, 16, 4) end)
+context:newpath()
+
+-- Stamping markers one at a time against in one call
+local positions = {}
+for index = 1, 1000 do
+	positions[#positions + 1] = (index * 37) % 64
+	positions[#positions + 1] = (index * 91) % 64
+end
+local packed = cairo.buffer(positions)
+context:arc(0, 0, 2, 0, 2 * math.pi)
+local marker = context:copypath()
+context:newpath()
+common.measure('draw.markers.lua', math.ceil(iterations / 1000), function()
+	for index = 1, #positions, 2 do
+		context:save()
+		context:translate(positions[index], positions[index + 1])
+		context:arc(0, 0, 2, 0, 2 * math.pi)
+		context:fill()
+		context:restore()
+	end
+end)
+common.measure('draw.markers.instances', math.ceil(iterations / 1000), function() context:instances(marker, packed) end)
+
+-- Repeated labels
+context:selectfontface('sans', cairo.fontslant.NORMAL, cairo.fontweight.NORMAL)
+context:setfontsize(10)
+common.measure('text.showtext', math.ceil(iterations / 10), function() context:moveto(0, 10) context:showtext('Label 42') end)
+common.measure('text.textpath', math.ceil(iterations / 10), function() context:moveto(0, 10) context:textpath('Label 42') context:fill() end)
+local labels = {}
+for index = 1, 100 do labels[index] = 'Label ' .. index end
+common.measure('text.textextents', math.ceil(iterations / 100), function() for index = 1, #labels do context:textextents(labels[index]) end end)
+common.measure('text.measuretexts', math.ceil(iterations / 100), function() return context:measuretexts(labels) end)
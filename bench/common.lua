@@ -0,0 +1,44 @@
+-- Shared benchmark helpers.
+-- Each result is printed as one tab separated line: name, iterations, total seconds, nanoseconds per iteration.
+
+local common = {}
+
+function common.report(name, iterations, elapsed)
+	print(string.format('%s\t%d\t%.6f\t%.1f', name, iterations, elapsed, elapsed * 1e9 / iterations))
+	io.stdout:flush()
+end
+
+-- Times iterations calls of call.  If collect is set, the full garbage collection afterwards is included so object
+-- creation is charged for its cleanup.
+function common.measure(name, iterations, call, collect)
+	collectgarbage('collect')
+	local start = os.clock()
+	for index = 1, iterations do
+		call()
+	end
+	if collect then collectgarbage('collect') end
+	common.report(name, iterations, os.clock() - start)
+end
+
+-- Like measure, but reports the memory allocated by the calls (with the collector stopped): total KiB in place of
+-- seconds and bytes per iteration in place of nanoseconds.
+function common.measurememory(name, iterations, call)
+	collectgarbage('collect')
+	collectgarbage('stop')
+	local start = collectgarbage('count')
+	for index = 1, iterations do
+		call()
+	end
+	local used = collectgarbage('count') - start
+	collectgarbage('restart')
+	collectgarbage('collect')
+	common.reportmemory(name, iterations, used)
+end
+
+-- Prints a memory result: KiB allocated over all iterations
+function common.reportmemory(name, iterations, used)
+	print(string.format('%s\t%d\t%.1f\t%.1f', name, iterations, used, used * 1024 / iterations))
+	io.stdout:flush()
+end
+
+return common
@@ -0,0 +1,20 @@
+-- End to end frame time for sample scripts.
+-- Run with: build/luacairo bench/samples.lua [--frames count] sample.lua...
+-- Samples write their output to the working directory.
+
+package.path = (arg[0]:match('(.*/)') or './') .. '?.lua;' .. package.path
+local common = require 'common'
+require 'cairo'
+
+local frames = 100
+local first = 1
+if arg[1] == '--frames' then
+	frames = tonumber(arg[2])
+	first = 3
+end
+
+for index = first, #arg do
+	local sample = assert(loadfile(arg[index]))
+	sample()
+	common.measure('sample.' .. arg[index]:match('([^/]*)%.lua$'), frames, sample, true)
+end
@@ -0,0 +1,64 @@
+-- Cost of opening the module: time and memory for luaopen_cairo alone, with the functions a typical script uses, and
+-- with everything created (what opening cost before registration was made lazy).
+-- Every sample runs in a new process with a new Lua state, so nothing created by an earlier sample is reused.
+-- Run with: build/luacairo bench/startup.lua [path to cairo.so] [samples] [interpreter]
+
+package.path = (arg[0]:match('(.*/)') or './') .. '?.lua;' .. package.path
+local common = require 'common'
+
+local library = arg[1] or '../cairo.so'
+
+local lazy = {
+	'antialias', 'fillrule', 'linecap', 'linejoin', 'operator', 'path', 'extend', 'filter', 'patterntype',
+	'regionoverlap', 'devicetype', 'content', 'surfacetype', 'format', 'rgbpattern', 'region', 'matrix',
+	'recordingsurface', 'svgsurface',
+}
+
+local cases =
+{
+	open = function(open) open() end,
+	typical = function(open)
+		local cairo = open()
+		local surface = cairo.imagesurface(cairo.format.ARGB32, 1, 1)
+		local context = cairo.context(surface)
+		local _ = context.moveto, context.lineto, context.setsourcergb, context.stroke, surface.getwidth
+	end,
+	everything = function(open)
+		local cairo = open()
+		for _, name in ipairs(lazy) do local _ = cairo[name] end
+		local surface = cairo.imagesurface(cairo.format.ARGB32, 1, 1)
+		local context = cairo.context(surface)
+		local _ = context.moveto, surface.getwidth, surface:getdata().getrows, context:getsource().getrgba,
+			context:gettarget().status, cairo.region().copy, cairo.matrix(1, 0, 0, 1, 0, 0).copy, cairo.buffer(1).get
+	end,
+}
+
+-- A sample: open the library in this process's state once and print seconds and KiB used
+if arg[2] == '--sample' then
+	local open = assert(package.loadlib(library, 'luaopen_cairo'))
+	collectgarbage('collect')
+	collectgarbage('stop')
+	local memory = collectgarbage('count')
+	local start = os.clock()
+	cases[arg[3]](open)
+	print(os.clock() - start, collectgarbage('count') - memory)
+	return
+end
+
+local samples = tonumber(arg[2]) or 100
+local interpreter = arg[3] or '../luacairo'
+for _, name in ipairs({'open', 'typical', 'everything'}) do
+	local command = string.format('%q %q %q --sample %s', interpreter, arg[0], library, name)
+	local elapsed, used = 0, 0
+	for sample = 1, samples do
+		local process = assert(io.popen(command))
+		local output = process:read('*a')
+		process:close()
+		local seconds, kib = output:match('^(%S+)%s+(%S+)')
+		assert(seconds, 'Sample failed: ' .. output)
+		elapsed = elapsed + tonumber(seconds)
+		used = used + tonumber(kib)
+	end
+	common.report('startup.' .. name, samples, elapsed)
+	common.reportmemory('startup.' .. name .. '.bytes', samples, used)
+end
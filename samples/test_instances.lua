@@ -0,0 +1,28 @@
+require 'cairo'
+
+local surface = cairo.imagesurface(cairo.format.ARGB32, 256, 256)
+local context = cairo.context(surface)
+
+context:arc(0, 0, 3, 0, 2 * math.pi)
+local marker = context:copypath()
+context:newpath()
+
+local positions, colors = {}, {}
+for index = 0, 999 do
+	local x, y = (index * 37) % 256, (index * 91) % 256
+	positions[#positions + 1] = x
+	positions[#positions + 1] = y
+	colors[#colors + 1] = x / 256
+	colors[#colors + 1] = y / 256
+	colors[#colors + 1] = 0.5
+	colors[#colors + 1] = 0.8
+end
+
+context:instances(marker, cairo.buffer(positions), colors)
+
+-- The current source is used without colors
+context:scale(2, 2)
+context:setsourcergb(0, 0, 0)
+context:instances(marker, {16, 16, 112, 112})
+
+surface:writetopng('test_instances.png')
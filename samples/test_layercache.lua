@@ -0,0 +1,39 @@
+require 'cairo'
+
+local surface = cairo.imagesurface(cairo.format.ARGB32, 128, 128)
+local context = cairo.context(surface)
+
+local draws = 0
+local function grid(layer)
+	draws = draws + 1
+	layer:setsourcergb(0.5, 0.5, 0.5)
+	for offset = 0, 64, 8 do
+		layer:moveto(offset, 0)
+		layer:lineto(offset, 64)
+		layer:moveto(0, offset)
+		layer:lineto(64, offset)
+	end
+	layer:stroke()
+end
+
+for frame = 1, 3 do
+	context:layercache('grid', 64, 64, grid)
+	context:layercache('grid raster', 64, 64, grid, true)
+end
+print('draws after 3 frames', draws) -- 2
+
+context:scale(2, 2)
+context:layercache('grid', 64, 64, grid)
+context:layercache('grid raster', 64, 64, grid, true)
+print('draws after scaling', draws) -- 3, only the raster layer is redrawn
+
+context:layercache('grid', 32, 32, grid)
+print('draws after resizing', draws) -- 4, a new size makes a new layer
+
+print('cache size', cairo.getlayercachesize())
+cairo.setlayercachebudget(0)
+print('cache size with no budget', cairo.getlayercachesize()) -- keeps the last layer
+cairo.clearlayercache()
+print('cache size after clear', cairo.getlayercachesize())
+
+surface:writetopng('test_layercache.png')
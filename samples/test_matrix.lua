@@ -0,0 +1,13 @@
+require 'cairo'
+
+local translate = cairo.translatematrix(10, 0)
+local scale = cairo.scalematrix(2, 2)
+local combined = translate * scale
+print(combined)
+print(combined:transformpoint(1, 1))
+print(combined == cairo.matrix(2, 0, 0, 2, 20, 0))
+
+local points = cairo.buffer({0, 0, 1, 1, 2, 3})
+combined:transformpointsinplace(points)
+print(points:get(3), points:get(4), #points)
+print(table.concat(combined:transformdistances({1, 0, 0, 1}), ' '))
@@ -0,0 +1,49 @@
+require 'cairo'
+
+local surface = cairo.imagesurface(cairo.format.ARGB32, 32, 32)
+local context = cairo.context(surface)
+context:setsourcergb(1, 0, 0)
+context:paint()
+
+local png = surface:topngstring()
+print(#png)
+
+local chunks = {}
+surface:writetopngstream(function(chunk) chunks[#chunks + 1] = chunk end, 64)
+assert(table.concat(chunks) == png)
+
+local copy = cairo.imagesurfacefrompngstring(png)
+print(copy:status())
+
+local offset = 1
+local streamed = cairo.imagesurfacefrompngstream(function(size)
+	if offset > #png then return nil end
+	local chunk = png:sub(offset, offset + 99)
+	offset = offset + #chunk
+	return chunk
+end)
+print(streamed:status())
+
+-- Encoding from inside a stream callback doesn't disturb the outer stream
+chunks = {}
+surface:writetopngstream(function(chunk)
+	chunks[#chunks + 1] = chunk
+	assert(surface:topngstring() == png)
+end, 64)
+assert(table.concat(chunks) == png)
+
+-- Releasing the surface from inside the callback doesn't free or recycle it mid-encode
+local pooled = cairo.pooledimagesurface(cairo.format.ARGB32, 32, 32)
+context = cairo.context(pooled)
+context:setsourcergb(1, 0, 0)
+context:paint()
+context = nil
+collectgarbage('collect')
+chunks = {}
+pooled:writetopngstream(function(chunk)
+	chunks[#chunks + 1] = chunk
+	pooled:release()
+	cairo.pooledimagesurface(cairo.format.ARGB32, 32, 32):release()
+end, 64)
+assert(table.concat(chunks) == png)
+print('released mid-encode', pcall(function() return pooled:getwidth() end)) -- false
@@ -0,0 +1,26 @@
+require 'cairo'
+
+local surface = cairo.imagesurface(cairo.format.ARGB32, 64, 64)
+local context = cairo.context(surface)
+
+context:polyline({4, 4, 60, 4, 60, 60})
+print(context:pathextents())
+context:newpath()
+
+context:polygon({4, 4, 60, 4, 32, 60})
+context:fill()
+
+local path = cairo.path
+context:pathcommands({path.MOVETO, path.CURVETO, path.CLOSEPATH}, {0, 0, 10, 0, 20, 10, 20, 20})
+print(context:pathextents())
+
+-- Paths as packed arrays
+context:newpath()
+context:polygon({4, 4, 60, 4, 32, 60})
+local copied = context:copypath()
+local operations, coordinates = copied:getoperations(), copied:getcoordinates()
+print(#operations, #coordinates) -- 5 operations (move, 2 lines, close, move), 8 coordinates
+local rebuilt = cairo.packedpath(operations, coordinates)
+context:newpath()
+context:appendpath(rebuilt)
+print(context:pathextents())
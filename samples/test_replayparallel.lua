@@ -0,0 +1,20 @@
+require 'cairo'
+
+-- Each thread replays its own recording, drawn by the function
+local surface = cairo.imagesurface(cairo.format.ARGB32, 512, 512)
+surface:replayparallel(function(context)
+	context:setsourcergb(0, 0, 1)
+	context:arc(256, 256, 200, 0, 2 * math.pi)
+	context:fill()
+end, 4)
+surface:writetopng('replayparallel.png')
+
+-- Image sources are read in place by every thread
+local copy = cairo.imagesurface(cairo.format.ARGB32, 512, 512)
+copy:replayparallel(surface, 4)
+print('image copied', copy:getdata():getrows(256, 1) == surface:getdata():getrows(256, 1)) -- true
+
+-- Recordings that draw other surfaces would share them between threads
+print('surface source refused', pcall(function()
+	copy:replayparallel(function(context) context:setsourcesurface(surface, 0, 0) context:paint() end, 4)
+end)) -- false
@@ -0,0 +1,33 @@
+require 'cairo'
+
+local surface = cairo.imagesurface(cairo.format.ARGB32, 128, 128)
+local context = cairo.context(surface)
+
+local builds = 0
+cairo.defineshape('roundedrectangle', function(shape, width, height, radius)
+	builds = builds + 1
+	shape:newsubpath()
+	shape:arc(width - radius, radius, radius, -math.pi / 2, 0)
+	shape:arc(width - radius, height - radius, radius, 0, math.pi / 2)
+	shape:arc(radius, height - radius, radius, math.pi / 2, math.pi)
+	shape:arc(radius, radius, radius, math.pi, 3 * math.pi / 2)
+	shape:closepath()
+end)
+
+context:setsourcergb(0.2, 0.4, 0.8)
+for row = 0, 3 do
+	for column = 0, 3 do
+		context:drawcached('roundedrectangle', 4 + column * 32, 4 + row * 32, 24, 24, 6)
+	end
+end
+context:fill()
+context:setsourcergb(0.8, 0.4, 0.2)
+context:drawcached('roundedrectangle', 8, 8, 48, 16, 8)
+context:fill()
+print('builds', builds) -- 2, one per set of parameters
+
+print('cache size', cairo.getshapecachesize())
+cairo.clearshapecache()
+print('cache size after clear', cairo.getshapecachesize())
+
+surface:writetopng('test_shapecache.png')
@@ -0,0 +1,24 @@
+require 'cairo'
+
+local first = cairo.pooledimagesurface(cairo.format.ARGB32, 32, 32)
+local context = cairo.context(first)
+context:setsourcergb(1, 0, 0)
+context:paint()
+context = nil
+collectgarbage('collect') -- Drop the context's reference so the surface can go back to the pool
+first:release()
+print('released use fails', pcall(function() return first:getwidth() end)) -- false
+
+local second = cairo.pooledimagesurface(cairo.format.ARGB32, 32, 32)
+print('reused surface is cleared', second:getdata():getrows(0, 1) == string.rep('\0', second:getstride())) -- true
+second:release()
+second:release() -- Releasing twice is harmless
+
+-- Surfaces still referenced elsewhere are not pooled
+local third = cairo.pooledimagesurface(cairo.format.ARGB32, 32, 32)
+local pattern = cairo.surfacepattern(third)
+third:release()
+print('pattern still valid', pattern:status()) -- 0
+
+cairo.setsurfacepoollimit(0)
+cairo.clearsurfacepool()
@@ -0,0 +1,39 @@
+require 'cairo'
+
+local surface = cairo.imagesurface(cairo.format.ARGB32, 256, 128)
+local context = cairo.context(surface)
+context:setsourcergb(1, 1, 1)
+context:paint()
+context:setsourcergb(0, 0, 0)
+
+context:selectfontface('sans', cairo.fontslant.NORMAL, cairo.fontweight.BOLD)
+context:setfontsize(16)
+context:moveto(8, 24)
+context:showtext('Hello ')
+context:showtext('world') -- continues from where the last call left off
+print('current point', context:getcurrentpoint())
+
+-- Glyph runs from a scaled font, laid out once and drawn anywhere
+local font = context:getscaledfont()
+print('font face', font:getfontface():getfamily())
+local glyphs, x, y = font:texttoglyphs('Label', 8, 56)
+print('glyphs', math.floor(#glyphs / 24), 'end', x, y) -- 24 byte cairo_glyph_t on 64 bit systems
+context:showglyphs(glyphs)
+context:showglyphs(font:texttoglyphs('Label', 8, 80))
+
+-- Extents, one string at a time or many at once
+print('text extents', context:textextents('Label'))
+print('font extents', context:fontextents())
+local measured = context:measuretexts({'Label', 'Longer label', ''})
+for index = 0, #measured / 6 - 1 do
+	print('measured', measured:get(index * 6 + 3), measured:get(index * 6 + 5)) -- width and x advance
+end
+
+-- Scaled fonts can also be made directly
+local face = cairo.toyfontface('serif', cairo.fontslant.ITALIC, cairo.fontweight.NORMAL)
+context:setscaledfont(cairo.scaledfont(face, 20))
+context:moveto(8, 112)
+context:textpath('Outlined')
+context:stroke()
+
+surface:writetopng('test_text.png')